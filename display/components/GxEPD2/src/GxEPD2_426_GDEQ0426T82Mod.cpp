@@ -12,6 +12,26 @@
 // Library: https://github.com/ZinggJM/GxEPD2
 
 #include "GxEPD2_426_GDEQ0426T82Mod.h"
+#include <esp_timer.h>
+
+namespace
+{
+  // reports its lifetime to the trace callback, if set
+  class TraceScope
+  {
+    public:
+      TraceScope(GxEPD2_426_GDEQ0426T82Mod::TraceCallback callback, GxEPD2_426_GDEQ0426T82Mod::TracePhase phase) :
+        _callback(callback), _phase(phase), _start_us(callback ? esp_timer_get_time() : 0) {}
+      ~TraceScope()
+      {
+        if (_callback) _callback(_phase, _start_us, esp_timer_get_time());
+      }
+    private:
+      GxEPD2_426_GDEQ0426T82Mod::TraceCallback _callback;
+      GxEPD2_426_GDEQ0426T82Mod::TracePhase _phase;
+      int64_t _start_us;
+  };
+}
 
 GxEPD2_426_GDEQ0426T82Mod::GxEPD2_426_GDEQ0426T82Mod(int16_t cs, int16_t dc, int16_t rst, int16_t busy) :
   GxEPD2_EPD(cs, dc, rst, busy, HIGH, 10000000, WIDTH, HEIGHT, panel, hasColor, hasPartialUpdate, hasFastPartialUpdate)
@@ -33,15 +53,22 @@ void GxEPD2_426_GDEQ0426T82Mod::writeScreenBuffer(uint8_t value)
 
 void GxEPD2_426_GDEQ0426T82Mod::_writeScreenBuffer(uint8_t command, uint8_t value)
 {
+  if (_refresh_pending) finishRefresh(); // the controller ignores commands while busy
+  TraceScope trace(_trace, TRACE_SPI_WRITE);
   if (!_init_display_done) _InitDisplay();
   _setPartialRamArea(0, 0, WIDTH, HEIGHT);
   _writeCommand(command);
   _startTransfer();
-  for (uint32_t i = 0; i < uint32_t(WIDTH) * uint32_t(HEIGHT) / 8; i++)
+  uint8_t row[WIDTH / 8];
+  memset(row, value, sizeof(row));
+  int64_t start = esp_timer_get_time();
+  for (uint16_t i = 0; i < HEIGHT; i++)
   {
-    _transfer(value);
+    _pSPIx->writeBytes(row, sizeof(row));
   }
+  _ram_write_us += esp_timer_get_time() - start;
   _endTransfer();
+  _ram_bytes_written += uint32_t(HEIGHT) * sizeof(row);
 }
 
 void GxEPD2_426_GDEQ0426T82Mod::writeImage(const uint8_t bitmap[], int16_t x, int16_t y, int16_t w, int16_t h, bool invert, bool mirror_y, bool pgm)
@@ -51,6 +78,7 @@ void GxEPD2_426_GDEQ0426T82Mod::writeImage(const uint8_t bitmap[], int16_t x, in
 
 void GxEPD2_426_GDEQ0426T82Mod::_writeImage(uint8_t command, const uint8_t bitmap[], int16_t x, int16_t y, int16_t w, int16_t h, bool invert, bool mirror_y, bool pgm)
 {
+  if (_refresh_pending) finishRefresh(); // the controller ignores commands while busy
   delay(1); // yield() to avoid WDT on ESP8266 and ESP32
   int16_t wb = (w + 7) / 8; // width bytes, bitmaps are padded
   x -= x % 8; // byte boundary
@@ -66,30 +94,22 @@ void GxEPD2_426_GDEQ0426T82Mod::_writeImage(uint8_t command, const uint8_t bitma
   if ((w1 <= 0) || (h1 <= 0)) return;
   if (!_init_display_done) _InitDisplay();
   if (_initial_write) writeScreenBuffer(); // initial full screen buffer clean
+  TraceScope trace(_trace, TRACE_SPI_WRITE); // after the initial clear, which is traced itself
   _setPartialRamArea(x1, y1, w1, h1);
   _writeCommand(command);
   _startTransfer();
-  for (int16_t i = 0; i < h1; i++)
+  if (!mirror_y && (w1 == w))
   {
-    for (int16_t j = 0; j < w1 / 8; j++)
+    // rows are contiguous in the bitmap, send them in one go
+    _transferBytes(&bitmap[int32_t(dy) * wb], uint32_t(wb) * h1, invert, pgm);
+  }
+  else
+  {
+    for (int16_t i = 0; i < h1; i++)
     {
-      uint8_t data;
       // use wb, h of bitmap for index!
-      int32_t idx = mirror_y ? j + dx / 8 + ((h - 1 - int32_t(i + dy))) * wb : j + dx / 8 + int32_t(i + dy) * wb;
-      if (pgm)
-      {
-#if defined(__AVR) || defined(ESP8266) || defined(ESP32)
-        data = pgm_read_byte(&bitmap[idx]);
-#else
-        data = bitmap[idx];
-#endif
-      }
-      else
-      {
-        data = bitmap[idx];
-      }
-      if (invert) data = ~data;
-      _transfer(data);
+      int32_t idx = mirror_y ? dx / 8 + ((h - 1 - int32_t(i + dy))) * wb : dx / 8 + int32_t(i + dy) * wb;
+      _transferBytes(&bitmap[idx], w1 / 8, invert, pgm);
     }
   }
   _endTransfer();
@@ -105,6 +125,7 @@ void GxEPD2_426_GDEQ0426T82Mod::writeImagePart(const uint8_t bitmap[], int16_t x
 void GxEPD2_426_GDEQ0426T82Mod::_writeImagePart(uint8_t command, const uint8_t bitmap[], int16_t x_part, int16_t y_part, int16_t w_bitmap, int16_t h_bitmap,
     int16_t x, int16_t y, int16_t w, int16_t h, bool invert, bool mirror_y, bool pgm)
 {
+  if (_refresh_pending) finishRefresh(); // the controller ignores commands while busy
   delay(1); // yield() to avoid WDT on ESP8266 and ESP32
   if ((w_bitmap < 0) || (h_bitmap < 0) || (w < 0) || (h < 0)) return;
   if ((x_part < 0) || (x_part >= w_bitmap)) return;
@@ -126,38 +147,68 @@ void GxEPD2_426_GDEQ0426T82Mod::_writeImagePart(uint8_t command, const uint8_t b
   if ((w1 <= 0) || (h1 <= 0)) return;
   if (!_init_display_done) _InitDisplay();
   if (_initial_write) writeScreenBuffer(); // initial full screen buffer clean
+  TraceScope trace(_trace, TRACE_SPI_WRITE); // after the initial clear, which is traced itself
   _setPartialRamArea(x1, y1, w1, h1);
   _writeCommand(command);
   _startTransfer();
   for (int16_t i = 0; i < h1; i++)
   {
-    for (int16_t j = 0; j < w1 / 8; j++)
+    // use wb_bitmap, h_bitmap of bitmap for index!
+    int32_t idx = mirror_y ? x_part / 8 + dx / 8 + int32_t((h_bitmap - 1 - (y_part + i + dy))) * wb_bitmap : x_part / 8 + dx / 8 + int32_t(y_part + i + dy) * wb_bitmap;
+    _transferBytes(&bitmap[idx], w1 / 8, invert, pgm);
+  }
+  _endTransfer();
+  delay(1); // yield() to avoid WDT on ESP8266 and ESP32
+}
+
+void GxEPD2_426_GDEQ0426T82Mod::_transferBytes(const uint8_t data[], uint32_t n, bool invert, bool pgm)
+{
+  _ram_bytes_written += n;
+  int64_t start = esp_timer_get_time();
+  if (!_bulk_transfer)
+  {
+    for (uint32_t j = 0; j < n; j++)
     {
-      uint8_t data;
-      // use wb_bitmap, h_bitmap of bitmap for index!
-      int32_t idx = mirror_y ? x_part / 8 + j + dx / 8 + int32_t((h_bitmap - 1 - (y_part + i + dy))) * wb_bitmap : x_part / 8 + j + dx / 8 + int32_t(y_part + i + dy) * wb_bitmap;
-      if (pgm)
-      {
 #if defined(__AVR) || defined(ESP8266) || defined(ESP32)
-        data = pgm_read_byte(&bitmap[idx]);
+      uint8_t value = pgm ? pgm_read_byte(&data[j]) : data[j];
 #else
-        data = bitmap[idx];
+      uint8_t value = data[j];
 #endif
-      }
-      else
-      {
-        data = bitmap[idx];
-      }
-      if (invert) data = ~data;
-      _transfer(data);
+      _pSPIx->transfer(invert ? ~value : value);
     }
+    _ram_write_us += esp_timer_get_time() - start;
+    return;
   }
-  _endTransfer();
-  delay(1); // yield() to avoid WDT on ESP8266 and ESP32
+  if (!invert && !pgm)
+  {
+    _pSPIx->writeBytes(data, n);
+    _ram_write_us += esp_timer_get_time() - start;
+    return;
+  }
+  // convert in chunks to keep the bulk transfer
+  uint8_t chunk[WIDTH / 8];
+  while (n > 0)
+  {
+    uint32_t len = n < sizeof(chunk) ? n : sizeof(chunk);
+    for (uint32_t j = 0; j < len; j++)
+    {
+#if defined(__AVR) || defined(ESP8266) || defined(ESP32)
+      uint8_t value = pgm ? pgm_read_byte(&data[j]) : data[j];
+#else
+      uint8_t value = data[j];
+#endif
+      chunk[j] = invert ? ~value : value;
+    }
+    _pSPIx->writeBytes(chunk, len);
+    data += len;
+    n -= len;
+  }
+  _ram_write_us += esp_timer_get_time() - start;
 }
 
 void GxEPD2_426_GDEQ0426T82Mod::refresh(bool partial_update_mode)
 {
+  if (_refresh_pending) finishRefresh(); // the controller ignores commands while busy
   if (partial_update_mode) refresh(0, 0, WIDTH, HEIGHT);
   else
   {
@@ -168,21 +219,59 @@ void GxEPD2_426_GDEQ0426T82Mod::refresh(bool partial_update_mode)
 
 void GxEPD2_426_GDEQ0426T82Mod::refresh(int16_t x, int16_t y, int16_t w, int16_t h)
 {
+  if (_refresh_pending) finishRefresh(); // the controller ignores commands while busy
   if (_initial_refresh) return refresh(false); // initial update needs be full update
   // chip always refreshes the whole screen
   _Update_Part();
 }
 
+void GxEPD2_426_GDEQ0426T82Mod::refreshAsync(bool partial_update_mode, TaskHandle_t task)
+{
+  if (_refresh_pending) finishRefresh();
+  _refresh_task = task;
+  _refresh_pending = true;
+  if (_trace) _refresh_start_us = esp_timer_get_time();
+  // BUSY is idle right now, thus the next release edge signals the completion
+  attachInterruptArg(_busy, _busyIsr, this, _busy_level == HIGH ? FALLING : RISING);
+  if (partial_update_mode && !_initial_refresh) _startUpdate_Part();
+  else
+  {
+    _startUpdate_Full();
+    _initial_refresh = false; // initial full update done
+  }
+}
+
+void GxEPD2_426_GDEQ0426T82Mod::finishRefresh()
+{
+  if (!_refresh_pending) return;
+  _waitWhileBusy("finishRefresh", full_refresh_time);
+  if (_trace) _trace(TRACE_WAIT_BUSY, _refresh_start_us, esp_timer_get_time());
+  detachInterrupt(_busy);
+  _refresh_pending = false;
+  _refresh_task = nullptr;
+  _power_is_on = false;
+}
+
+void IRAM_ATTR GxEPD2_426_GDEQ0426T82Mod::_busyIsr(void* arg)
+{
+  GxEPD2_426_GDEQ0426T82Mod* epd = static_cast<GxEPD2_426_GDEQ0426T82Mod*>(arg);
+  BaseType_t woken = pdFALSE;
+  if (epd->_refresh_task) vTaskNotifyGiveFromISR(epd->_refresh_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
 void GxEPD2_426_GDEQ0426T82Mod::powerOff()
 {
 }
 
 void GxEPD2_426_GDEQ0426T82Mod::hibernate()
 {
-  if (_rst >= 0)
+  if (_refresh_pending) finishRefresh(); // the controller ignores commands while busy
+  if ((_rst >= 0) && !_hibernating)
   {
+    TraceScope trace(_trace, TRACE_HIBERNATE);
     _writeCommand(0x10); // deep sleep mode
-    _writeData(0x3);     // enter deep sleep
+    _writeData(0x1);     // enter deep sleep mode 1, retains RAM for partial RAM updates
     _hibernating = true;
     _init_display_done = false;
     // FIXME
@@ -246,6 +335,24 @@ void GxEPD2_426_GDEQ0426T82Mod::_InitDisplay()
 
 void GxEPD2_426_GDEQ0426T82Mod::_Update_Full()
 {
+  _startUpdate_Full();
+  TraceScope trace(_trace, TRACE_WAIT_BUSY);
+  _waitWhileBusy("_Update_Full", full_refresh_time);
+  _power_is_on = false;
+}
+
+void GxEPD2_426_GDEQ0426T82Mod::_Update_Part()
+{
+  _startUpdate_Part();
+  TraceScope trace(_trace, TRACE_WAIT_BUSY);
+  _waitWhileBusy("_Update_Part", partial_refresh_time);
+  _power_is_on = false;
+}
+
+void GxEPD2_426_GDEQ0426T82Mod::_startUpdate_Full()
+{
+  TraceScope trace(_trace, TRACE_REFRESH_START);
+  if (!_init_display_done) _InitDisplay(); // wakes up from deep sleep, the RAM is retained
   if (useFastFullUpdate)
   {
     // from official example code
@@ -260,15 +367,32 @@ void GxEPD2_426_GDEQ0426T82Mod::_Update_Full()
     _writeData(0xf7);
   }
   _writeCommand(0x20);
-  _waitWhileBusy("_Update_Full", full_refresh_time);
-  _power_is_on = false;
 }
 
-void GxEPD2_426_GDEQ0426T82Mod::_Update_Part()
+void GxEPD2_426_GDEQ0426T82Mod::_startUpdate_Part()
 {
-  _writeCommand(0x22);
-  _writeData(0xff);
+  TraceScope trace(_trace, TRACE_REFRESH_START);
+  if (!_init_display_done) _InitDisplay(); // wakes up from deep sleep, the RAM is retained
+  if ((_partial_waveform == WAVEFORM_CUSTOM) && _custom_lut)
+  {
+    // the LUT register is lost in deep sleep, thus load it for each update
+    _writeCommand(0x32); // write LUT register
+    _writeData(_custom_lut, custom_lut_size);
+    _writeCommand(0x22);
+    _writeData(0xcf); // display mode 2 without loading temperature and LUT
+  }
+  else if (_partial_waveform == WAVEFORM_FAST)
+  {
+    // same approach as the fast full update
+    _writeCommand(0x1A); // Write to temperature register
+    _writeData(0x5A); // 90 degrees Celsius
+    _writeCommand(0x22);
+    _writeData(0xdf); // display mode 2, load LUT for the written temperature
+  }
+  else
+  {
+    _writeCommand(0x22);
+    _writeData(0xff); // reloads temperature and LUT, thus also restores the stock waveform
+  }
   _writeCommand(0x20);
-  _waitWhileBusy("_Update_Part", partial_refresh_time);
-  _power_is_on = false;
 }
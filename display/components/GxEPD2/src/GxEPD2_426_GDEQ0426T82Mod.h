@@ -15,6 +15,8 @@
 #define _GxEPD2_426_GDEQ0426T82Mod_H_
 
 #include "../code/src/GxEPD2_EPD.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 class GxEPD2_426_GDEQ0426T82Mod : public GxEPD2_EPD
 {
@@ -32,6 +34,25 @@ class GxEPD2_426_GDEQ0426T82Mod : public GxEPD2_EPD
     static const uint16_t power_off_time = 200; // ms, e.g. 138810us
     static const uint16_t full_refresh_time = 1600; // ms, e.g. 1567341us
     static const uint16_t partial_refresh_time = 600; // ms, e.g. 499962us
+    static const uint16_t custom_lut_size = 105; // bytes of the LUT register, command 0x32
+    // waveforms for partial updates
+    enum Waveform
+    {
+      WAVEFORM_STOCK = 0, // OTP waveform for the measured temperature
+      WAVEFORM_FAST,      // OTP waveform for high temperatures, faster at the cost of contrast
+      WAVEFORM_CUSTOM,    // LUT set by setCustomLut(), falls back to stock if none is set
+      WAVEFORM_COUNT
+    };
+    // phases reported to the trace callback
+    enum TracePhase
+    {
+      TRACE_SPI_WRITE = 0, // sending pixel data to the controller RAM
+      TRACE_WAIT_BUSY,     // waiting for a refresh to complete
+      TRACE_HIBERNATE,
+      TRACE_REFRESH_START  // waking up the controller and sending the refresh commands
+    };
+    // called with the start and end time in microseconds of esp_timer_get_time()
+    typedef void (*TraceCallback)(TracePhase phase, int64_t start_us, int64_t end_us);
     // constructor
     GxEPD2_426_GDEQ0426T82Mod(int16_t cs, int16_t dc, int16_t rst, int16_t busy);
     // methods (virtual)
@@ -46,15 +67,48 @@ class GxEPD2_426_GDEQ0426T82Mod : public GxEPD2_EPD
     void refresh(int16_t x, int16_t y, int16_t w, int16_t h); // screen refresh from controller memory, partial screen
     void powerOff(); // turns off generation of panel driving voltages, avoids screen fading over time
     void hibernate(); // turns powerOff() and sets controller to deep sleep for minimum power use, ONLY if wakeable by RST (rst >= 0)
+    // screen refresh from controller memory without waiting for completion, the task is notified once BUSY is released;
+    // all other methods first wait until the refresh has completed
+    void refreshAsync(bool partial_update_mode, TaskHandle_t task);
+    bool isRefreshing() const { return _refresh_pending; }
+    bool isBusy() const { return digitalRead(_busy) == _busy_level; }
+    void finishRefresh(); // waits for the refresh to complete
+    void setPartialWaveform(Waveform waveform) { _partial_waveform = waveform; } // used by the following partial updates
+    Waveform partialWaveform() const { return _partial_waveform; }
+    // waveform LUT for command 0x32, must stay valid while set; nullptr or a size other than custom_lut_size removes it
+    void setCustomLut(const uint8_t lut[], uint16_t size) { _custom_lut = size == custom_lut_size ? lut : nullptr; }
+    bool hasCustomLut() const { return _custom_lut != nullptr; }
+    // number of pixel data bytes sent to the controller RAM, wraps around
+    uint32_t ramBytesWritten() const { return _ram_bytes_written; }
+    // time spent sending pixel data in microseconds, wraps around; the CPU is busy meanwhile
+    uint32_t ramWriteMicros() const { return _ram_write_us; }
+    // send the pixel data byte by byte like the stock driver instead of in bulk, for comparing both
+    void setBulkTransfer(bool bulk) { _bulk_transfer = bulk; }
+    // reports the duration of the driver phases, nullptr disables tracing
+    void setTraceCallback(TraceCallback callback) { _trace = callback; }
   private:
+    static void _busyIsr(void* arg);
+    void _startUpdate_Full();
+    void _startUpdate_Part();
     void _writeScreenBuffer(uint8_t command, uint8_t value);
     void _writeImage(uint8_t command, const uint8_t bitmap[], int16_t x, int16_t y, int16_t w, int16_t h, bool invert = false, bool mirror_y = false, bool pgm = false);
     void _writeImagePart(uint8_t command, const uint8_t bitmap[], int16_t x_part, int16_t y_part, int16_t w_bitmap, int16_t h_bitmap,
                          int16_t x, int16_t y, int16_t w, int16_t h, bool invert = false, bool mirror_y = false, bool pgm = false);
+    // send bitmap data with bulk SPI transfers unless disabled, must be called within _startTransfer() / _endTransfer()
+    void _transferBytes(const uint8_t data[], uint32_t n, bool invert, bool pgm);
     void _setPartialRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
     void _InitDisplay();
     void _Update_Full();
     void _Update_Part();
+    bool _refresh_pending = false;
+    TaskHandle_t _refresh_task = nullptr;
+    TraceCallback _trace = nullptr;
+    int64_t _refresh_start_us = 0;
+    Waveform _partial_waveform = WAVEFORM_STOCK;
+    const uint8_t* _custom_lut = nullptr;
+    bool _bulk_transfer = true;
+    uint32_t _ram_bytes_written = 0;
+    uint32_t _ram_write_us = 0;
 };
 
 #endif
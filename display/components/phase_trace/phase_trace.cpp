@@ -0,0 +1,80 @@
+#include "phase_trace.h"
+
+#if CONFIG_PHASE_TRACE_ENABLE
+
+#include <algorithm>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+namespace PhaseTrace {
+
+static const char* TAG = "trace";
+
+static const char* const PHASE_NAMES[PHASE_COUNT] = {
+    "wifi connect", "http connect", "http headers", "body receive", "hash",
+    "blit", "spi write", "refresh start", "wait busy", "hibernate",
+};
+
+struct Event {
+    int64_t startUs;
+    uint32_t durationUs;
+    Phase phase;
+};
+
+struct Stats {
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+};
+
+constexpr size_t MAX_EVENTS = CONFIG_PHASE_TRACE_EVENTS;
+
+static Event events[MAX_EVENTS];
+// index of the next event to write and number of recorded events
+static size_t next;
+static size_t count;
+static Stats stats[PHASE_COUNT];
+
+int64_t now() {
+    return esp_timer_get_time();
+}
+
+void record(Phase phase, int64_t startUs, int64_t endUs) {
+    uint32_t durationUs = endUs - startUs;
+    events[next] = {startUs, durationUs, phase};
+    next = (next + 1) % MAX_EVENTS;
+    count = std::min(count + 1, MAX_EVENTS);
+
+    Stats& s = stats[phase];
+    s.minUs = s.count == 0 ? durationUs : std::min(s.minUs, durationUs);
+    s.maxUs = std::max(s.maxUs, durationUs);
+    s.totalUs += durationUs;
+    s.count++;
+}
+
+void logStats() {
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        const Stats& s = stats[i];
+        if (s.count > 0) {
+            ESP_LOGI(TAG, "%-13s %6lu times, min %7lu us, avg %7lu us, max %7lu us", PHASE_NAMES[i],
+                     (unsigned long)s.count, (unsigned long)s.minUs, (unsigned long)(s.totalUs / s.count),
+                     (unsigned long)s.maxUs);
+        }
+    }
+}
+
+void dump(FILE* out) {
+    fputs("{\"traceEvents\":[", out);
+    for (size_t i = 0; i < count; i++) {
+        const Event& e = events[(next + MAX_EVENTS - count + i) % MAX_EVENTS];
+        fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lu,\"pid\":1,\"tid\":1}", i > 0 ? "," : "",
+                PHASE_NAMES[e.phase], (long long)e.startUs, (unsigned long)e.durationUs);
+    }
+    fputs("\n]}\n", out);
+    count = 0;
+}
+
+} // namespace PhaseTrace
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include "sdkconfig.h"
+
+// Lightweight tracer for the phases of a dashboard update.
+//
+// Events are recorded with microsecond timestamps into a fixed-size ring buffer, along
+// with the minimum, average and maximum duration per phase. Use the PHASE_TRACE_* macros,
+// which compile to nothing unless CONFIG_PHASE_TRACE_ENABLE is set. Recording is not
+// thread safe, only the update task records phases.
+namespace PhaseTrace {
+
+enum Phase : uint8_t {
+    WIFI_CONNECT,
+    HTTP_CONNECT,
+    // sending the request and receiving the response headers
+    HTTP_HEADERS,
+    BODY_RECEIVE,
+    HASH,
+    // rotating changed pixels into the RAM window
+    BLIT,
+    SPI_WRITE,
+    // waking up the display controller and sending the refresh commands
+    REFRESH_START,
+    WAIT_BUSY,
+    HIBERNATE,
+    PHASE_COUNT
+};
+
+#if CONFIG_PHASE_TRACE_ENABLE
+
+int64_t now();
+void record(Phase phase, int64_t startUs, int64_t endUs);
+// Log count, min, avg and max duration of each phase
+void logStats();
+// Write the recorded events in Chrome trace format, see chrome://tracing or
+// https://ui.perfetto.dev. Afterwards, the ring buffer is empty.
+void dump(FILE* out);
+
+// Records the lifetime of the object as phase
+class Scope {
+public:
+    explicit Scope(Phase phase) : phase_(phase), start_(now()) {}
+    ~Scope() { record(phase_, start_, now()); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Phase phase_;
+    int64_t start_;
+};
+
+#endif
+
+} // namespace PhaseTrace
+
+#if CONFIG_PHASE_TRACE_ENABLE
+#define PHASE_TRACE_CONCAT_(a, b) a##b
+#define PHASE_TRACE_CONCAT(a, b) PHASE_TRACE_CONCAT_(a, b)
+#define PHASE_TRACE_SCOPE(phase) PhaseTrace::Scope PHASE_TRACE_CONCAT(phaseTraceScope, __LINE__)(PhaseTrace::phase)
+#define PHASE_TRACE_RECORD(phase, startUs, endUs) PhaseTrace::record(PhaseTrace::phase, startUs, endUs)
+#else
+#define PHASE_TRACE_SCOPE(phase) do {} while (0)
+#define PHASE_TRACE_RECORD(phase, startUs, endUs) do {} while (0)
+#endif
@@ -0,0 +1,341 @@
+// Benchmark of the frame path on the host: decoding the server responses, diffing against
+// the frame copy and rotating the changed windows into the emulated controller RAM. The
+// frames are dashboards captured from the server, see fixtures/update.sh.
+//
+// The ratio is the frame size divided by the response body. The CPU times are those of the
+// host and only useful for comparing changes, MB/s is the frame size divided by the CPU
+// time. The RAM bytes and SPI transactions are exact. The SPI time can only be measured on
+// the device, see CONFIG_DISPLAY_SPI_BENCHMARK and the debug log of each download.
+//
+// The hash comparison pits the byte-wise hash*31, which detected changes of the whole frame
+// before, against the word-wise FNV-1a of the strip hashes. Collisions count the variants
+// of each strip of the dashboard, with two adjacent bytes replaced like a changed digit,
+// that keep the hash of the original strip.
+//
+// The blit comparison rotates the full dashboard into the controller RAM, once with
+// Adafruit_GFX::drawBitmap() into the GxEPD2_BW buffer as displayDashboard() did before
+// FrameWriter, and once with the 8x8 transposes of FrameWriter.
+//
+// Usage: benchmark [fixtures] [--iterations N]
+//
+// The fixtures default to those in the source tree.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <string>
+#include "fake_server.h"
+#include "frame_writer.h"
+#include "packbits.h"
+
+using namespace HostTest;
+using WeatherDisplay::FrameWriter;
+using WeatherDisplay::PackBitsDecoder;
+
+namespace {
+
+// Typical size of the data returned by one socket read
+constexpr size_t READ_CHUNK = 1436;
+
+std::string fixtures = FIXTURES_DIR;
+
+// Pixel data of a captured dashboard
+Bytes readFrame(const char* name) {
+    std::ifstream in(fixtures + "/" + name, std::ios::binary);
+    Bytes file(std::istreambuf_iterator<char>(in), {});
+    // The server writes the header without comments
+    const char header[] = "P4\n480 800\n";
+    if (file.size() != sizeof(header) - 1 + FrameWriter::FRAME_BYTES ||
+        memcmp(file.data(), header, sizeof(header) - 1) != 0) {
+        fprintf(stderr, "%s/%s: no 480x800 frame\n", fixtures.c_str(), name);
+        exit(1);
+    }
+    return Bytes(file.begin() + sizeof(header) - 1, file.end());
+}
+
+enum class Encoding {
+    RAW,
+    PACKBITS,
+    DELTA
+};
+
+struct Scenario {
+    const char* name;
+    Encoding encoding;
+    // nullptr for a frame copy that is not known, e.g. after booting
+    const Bytes* base;
+    const Bytes* frame;
+};
+
+struct Result {
+    size_t bodyBytes;
+    uint32_t ramBytes;
+    uint32_t transactions;
+    int changedStrips;
+    double cpuUs;
+};
+
+Result run(const Scenario& scenario, int iterations) {
+    static GxEPD2_426_GDEQ0426T82Mod epd;
+    static FrameWriter writer(epd);
+    static PackBitsDecoder decoder(writer);
+
+    Bytes body;
+    switch (scenario.encoding) {
+    case Encoding::RAW:
+        body = *scenario.frame;
+        break;
+    case Encoding::PACKBITS:
+        body = packBits(*scenario.frame);
+        break;
+    case Encoding::DELTA:
+        body = delta(*scenario.base, *scenario.frame);
+        break;
+    }
+
+    Result result = {body.size(), 0, 0, 0, 0};
+    auto nextSize = [] { return READ_CHUNK; };
+    for (int i = 0; i < iterations; i++) {
+        writer.invalidate();
+        if (scenario.base) {
+            writer.begin();
+            writer.write(scenario.base->data(), scenario.base->size());
+        }
+        epd.controller().resetCounters();
+
+        int changedStrips = 0;
+        auto start = std::chrono::steady_clock::now();
+        switch (scenario.encoding) {
+        case Encoding::RAW:
+            writer.begin();
+            writeChunked(writer, body.data(), body.size(), nextSize);
+            changedStrips = writer.changedStrips();
+            break;
+        case Encoding::PACKBITS:
+            writer.begin();
+            decoder.begin();
+            writeChunked(decoder, body.data(), body.size(), nextSize);
+            changedStrips = writer.changedStrips();
+            break;
+        case Encoding::DELTA:
+            changedStrips = applyDelta(writer, body, READ_CHUNK);
+            if (changedStrips < 0) {
+                fprintf(stderr, "%s: invalid delta\n", scenario.name);
+                exit(1);
+            }
+            break;
+        }
+        result.changedStrips = changedStrips;
+        result.cpuUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        if (memcmp(writer.frame(), scenario.frame->data(), FrameWriter::FRAME_BYTES) != 0 ||
+            epd.controller().invalidWrites() != 0) {
+            fprintf(stderr, "%s: wrong frame\n", scenario.name);
+            exit(1);
+        }
+    }
+
+    result.ramBytes = epd.controller().ramBytes();
+    result.transactions = epd.controller().transactions();
+    result.cpuUs /= iterations;
+    return result;
+}
+
+// Port of the drawing path of Adafruit_GFX 1.11 and GxEPD2_BW with one page. drawBitmap()
+// calls the virtual writePixel() per set pixel, which maps the rotation to the buffer.
+class BufferedDisplay {
+public:
+    static constexpr int16_t WIDTH = GxEPD2_426_GDEQ0426T82Mod::WIDTH;
+    static constexpr int16_t HEIGHT = GxEPD2_426_GDEQ0426T82Mod::HEIGHT;
+
+    virtual ~BufferedDisplay() = default;
+
+    void fillScreen(uint8_t value) { memset(buffer_, value, sizeof(buffer_)); }
+    const uint8_t* buffer() const { return buffer_; }
+
+    // Adafruit_GFX::drawBitmap() for bitmaps in RAM, only sets the pixels that are 1
+    __attribute__((noinline)) void drawBitmap(int16_t x, int16_t y, const uint8_t* bitmap, int16_t w, int16_t h,
+                                              bool black) {
+        int16_t byteWidth = (w + 7) / 8;
+        uint8_t b = 0;
+        for (int16_t j = 0; j < h; j++, y++) {
+            for (int16_t i = 0; i < w; i++) {
+                if (i & 7) {
+                    b <<= 1;
+                } else {
+                    b = bitmap[j * byteWidth + i / 8];
+                }
+                if (b & 0x80) {
+                    writePixel(x + i, y, black);
+                }
+            }
+        }
+    }
+
+    virtual void writePixel(int16_t x, int16_t y, bool black) { drawPixel(x, y, black); }
+
+    // GxEPD2_BW::drawPixel() with rotation 3
+    virtual void drawPixel(int16_t x, int16_t y, bool black) {
+        if (x < 0 || x >= HEIGHT || y < 0 || y >= WIDTH) {
+            return;
+        }
+        std::swap(x, y);
+        y = HEIGHT - y - 1;
+        uint32_t i = x / 8 + y * (WIDTH / 8);
+        if (black) {
+            buffer_[i] = buffer_[i] & (0xFF ^ (1 << (7 - x % 8)));
+        } else {
+            buffer_[i] = buffer_[i] | (1 << (7 - x % 8));
+        }
+    }
+
+private:
+    uint8_t buffer_[WIDTH / 8 * HEIGHT];
+};
+
+Bytes controllerRam(const GxEPD2_426_GDEQ0426T82Mod& epd) {
+    Bytes ram;
+    for (uint16_t y = 0; y < HostTest::Ssd1677::RAM_HEIGHT; y++) {
+        const uint8_t* row = epd.controller().ramRow(y);
+        ram.insert(ram.end(), row, row + HostTest::Ssd1677::RAM_ROW_BYTES);
+    }
+    return ram;
+}
+
+// Rotate the full frame into the controller RAM with both paths, the RAM must end up equal
+void benchmarkBlit(const Bytes& frame, int iterations) {
+    static GxEPD2_426_GDEQ0426T82Mod epd;
+    static FrameWriter writer(epd);
+    static BufferedDisplay display;
+
+    double drawBitmapUs = 0;
+    double transposeUs = 0;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        display.fillScreen(0xFF);
+        display.drawBitmap(0, 0, frame.data(), FrameWriter::WIDTH, FrameWriter::HEIGHT, true);
+        epd.writeImage(display.buffer(), 0, 0, BufferedDisplay::WIDTH, BufferedDisplay::HEIGHT);
+        drawBitmapUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    Bytes expected = controllerRam(epd);
+
+    for (int i = 0; i < iterations; i++) {
+        epd.controller().fill(0x00);
+        writer.invalidate();
+        auto start = std::chrono::steady_clock::now();
+        writer.begin();
+        writer.write(frame.data(), frame.size());
+        transposeUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (controllerRam(epd) != expected) {
+        fprintf(stderr, "blit: the rotated frames differ\n");
+        exit(1);
+    }
+
+    drawBitmapUs /= iterations;
+    transposeUs /= iterations;
+    printf("%-24s %9.1f\n", "drawBitmap", drawBitmapUs);
+    printf("%-24s %9.1f %7.1fx\n", "FrameWriter, transpose", transposeUs, drawBitmapUs / transposeUs);
+}
+
+// Hash of checkForDashboardChange() before the strip hashes
+uint32_t hashBytes31(const uint8_t* data, size_t len) {
+    uint32_t hash = 0;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash * 31) + data[i];
+    }
+    return hash;
+}
+
+// Storing the hashes keeps the compiler from dropping the calls
+volatile uint32_t hashSink;
+
+template <typename Hash>
+void benchmarkHash(const char* name, Hash hash, const Bytes& frame, int iterations) {
+    constexpr size_t STRIP_BYTES = FrameWriter::STRIP_ROWS * FrameWriter::ROW_BYTES;
+
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        sum += hash(frame.data(), frame.size());
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    hashSink = sum;
+
+    std::mt19937 rng(1);
+    size_t variants = 0;
+    size_t collisions = 0;
+    for (size_t strip = 0; strip < FrameWriter::STRIPS; strip++) {
+        Bytes original(frame.begin() + strip * STRIP_BYTES, frame.begin() + (strip + 1) * STRIP_BYTES);
+        uint32_t originalHash = hash(original.data(), original.size());
+        for (int i = 0; i < 50 * iterations; i++) {
+            Bytes variant = original;
+            size_t pos = rng() % (STRIP_BYTES - 1);
+            variant[pos] = rng();
+            variant[pos + 1] = rng();
+            if (variant == original) {
+                continue;
+            }
+            variants++;
+            collisions += hash(variant.data(), variant.size()) == originalHash;
+        }
+    }
+
+    printf("%-24s %8.1f %10zu %10zu\n", name, frame.size() * iterations / us, collisions, variants);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 200;
+    int i = 1;
+    if (i < argc && strncmp(argv[i], "--", 2) != 0) {
+        fixtures = argv[i++];
+    }
+    for (; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--iterations") == 0) {
+            iterations = atoi(argv[i + 1]);
+        }
+    }
+
+    // One temperature, the values of all rooms, and the next day with other weather
+    Bytes dashboard = readFrame("dashboard.pbm");
+    Bytes sensor = readFrame("dashboard_sensor.pbm");
+    Bytes rooms = readFrame("dashboard_rooms.pbm");
+    Bytes other = readFrame("dashboard_other.pbm");
+
+    const Scenario scenarios[] = {
+        {"boot, raw", Encoding::RAW, nullptr, &dashboard},
+        {"boot, packbits", Encoding::PACKBITS, nullptr, &dashboard},
+        {"unchanged, raw", Encoding::RAW, &dashboard, &dashboard},
+        {"unchanged, delta", Encoding::DELTA, &dashboard, &dashboard},
+        {"sensor value, raw", Encoding::RAW, &dashboard, &sensor},
+        {"sensor value, packbits", Encoding::PACKBITS, &dashboard, &sensor},
+        {"sensor value, delta", Encoding::DELTA, &dashboard, &sensor},
+        {"all rooms, delta", Encoding::DELTA, &dashboard, &rooms},
+        {"new dashboard, packbits", Encoding::PACKBITS, &dashboard, &other},
+    };
+
+    printf("%-24s %8s %7s %8s %6s %7s %9s %8s\n", "scenario", "body B", "ratio", "RAM B", "strips", "SPI tx",
+           "CPU us", "MB/s");
+    for (const Scenario& scenario : scenarios) {
+        Result result = run(scenario, iterations);
+        printf("%-24s %8zu %7.1f %8lu %6d %7lu %9.1f %8.1f\n", scenario.name, result.bodyBytes,
+               (double)FrameWriter::FRAME_BYTES / result.bodyBytes, (unsigned long)result.ramBytes,
+               result.changedStrips, (unsigned long)result.transactions, result.cpuUs,
+               FrameWriter::FRAME_BYTES / result.cpuUs);
+    }
+
+    printf("\n%-24s %8s %10s %10s\n", "hash", "MB/s", "collisions", "variants");
+    benchmarkHash("hash*31, bytes", hashBytes31, dashboard, iterations);
+    benchmarkHash("FNV-1a, 32 bit words", FrameWriter::hashWords, dashboard, iterations);
+
+    printf("\n%-24s %9s %8s\n", "blit", "CPU us", "speedup");
+    benchmarkBlit(dashboard, iterations);
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "fake_server.h"
+#include <algorithm>
+
+using WeatherDisplay::FrameWriter;
+
+namespace HostTest {
+
+Bytes packBits(const Bytes& frame) {
+    Bytes out;
+    size_t i = 0;
+    while (i < frame.size()) {
+        // Length of the run of identical bytes starting at i
+        size_t run = 1;
+        while (run < 128 && i + run < frame.size() && frame[i + run] == frame[i]) {
+            run++;
+        }
+        if (run >= 2) {
+            out.push_back(uint8_t(1 - int(run)));
+            out.push_back(frame[i]);
+            i += run;
+            continue;
+        }
+
+        // Collect literal bytes until the next run of at least three identical bytes
+        size_t literal = 1;
+        while (literal < 128 && i + literal < frame.size()) {
+            size_t j = i + literal;
+            if (j + 2 < frame.size() && frame[j] == frame[j + 1] && frame[j] == frame[j + 2]) {
+                break;
+            }
+            literal++;
+        }
+        out.push_back(uint8_t(literal - 1));
+        out.insert(out.end(), frame.begin() + i, frame.begin() + i + literal);
+        i += literal;
+    }
+    return out;
+}
+
+Bytes delta(const Bytes& base, const Bytes& frame) {
+    constexpr size_t bytesPerRow = FrameWriter::ROW_BYTES;
+    constexpr size_t height = FrameWriter::HEIGHT;
+    constexpr size_t blockRows = (height + 7) / 8;
+
+    auto blockChanged = [&](size_t bx, size_t by) {
+        for (size_t y = by * 8; y < std::min(by * 8 + 8, height); y++) {
+            if (base[y * bytesPerRow + bx] != frame[y * bytesPerRow + bx]) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Merge changed blocks into horizontal spans and extend spans from the previous
+    // block row that have exactly the same horizontal extent
+    struct Patch {
+        size_t x, y, w, h;
+    };
+    std::vector<Patch> patches;
+    std::vector<size_t> previousRow;
+    for (size_t by = 0; by < blockRows; by++) {
+        std::vector<size_t> currentRow;
+        for (size_t bx = 0; bx < bytesPerRow; bx++) {
+            if (!blockChanged(bx, by)) {
+                continue;
+            }
+            size_t end = bx + 1;
+            while (end < bytesPerRow && blockChanged(end, by)) {
+                end++;
+            }
+            size_t rowHeight = std::min<size_t>(8, height - by * 8);
+            auto above = std::find_if(previousRow.begin(), previousRow.end(), [&](size_t p) {
+                return patches[p].x == bx * 8 && patches[p].w == (end - bx) * 8;
+            });
+            if (above != previousRow.end()) {
+                patches[*above].h += rowHeight;
+                currentRow.push_back(*above);
+            } else {
+                patches.push_back({bx * 8, by * 8, (end - bx) * 8, rowHeight});
+                currentRow.push_back(patches.size() - 1);
+            }
+            bx = end;
+        }
+        previousRow = currentRow;
+    }
+
+    Bytes out;
+    auto u16 = [&](size_t value) {
+        out.push_back(value & 0xFF);
+        out.push_back(value >> 8);
+    };
+    u16(patches.size());
+    for (const Patch& patch : patches) {
+        u16(patch.x);
+        u16(patch.y);
+        u16(patch.w);
+        u16(patch.h);
+        for (size_t y = patch.y; y < patch.y + patch.h; y++) {
+            auto start = frame.begin() + y * bytesPerRow + patch.x / 8;
+            out.insert(out.end(), start, start + patch.w / 8);
+        }
+    }
+    return out;
+}
+
+uint32_t frameHash(const Bytes& frame) {
+    constexpr size_t stripBytes = FrameWriter::STRIP_ROWS * FrameWriter::ROW_BYTES;
+    uint32_t hash = FrameWriter::HASH_OFFSET;
+    for (size_t i = 0; i < frame.size(); i += stripBytes) {
+        hash = (hash ^ FrameWriter::hashWords(frame.data() + i, stripBytes)) * FrameWriter::HASH_PRIME;
+    }
+    return hash;
+}
+
+Bytes frameChunk(const Bytes& frame, uint32_t hash, uint16_t index) {
+    constexpr uint32_t magic = 0x57444d43;
+    constexpr size_t chunkRows = 16;
+    constexpr size_t chunkBytes = chunkRows * FrameWriter::ROW_BYTES;
+    constexpr uint16_t count = FrameWriter::HEIGHT / chunkRows;
+
+    Bytes out;
+    auto u16 = [&](uint32_t value) {
+        out.push_back(value & 0xFF);
+        out.push_back(value >> 8);
+    };
+    auto u32 = [&](uint32_t value) {
+        u16(value & 0xFFFF);
+        u16(value >> 16);
+    };
+    const uint8_t* rows = frame.data() + index * chunkBytes;
+    u32(magic);
+    u32(hash);
+    u16(index);
+    u16(count);
+    u32(FrameWriter::hashWords(rows, chunkBytes));
+    out.insert(out.end(), rows, rows + chunkBytes);
+    return out;
+}
+
+int applyDelta(FrameWriter& writer, const Bytes& body, size_t chunk) {
+    auto u16 = [&](size_t pos) { return uint16_t(body[pos] | (body[pos + 1] << 8)); };
+    if (body.size() < 2) {
+        return -1;
+    }
+    int changedStrips = 0;
+    size_t pos = 2;
+    for (uint16_t i = 0; i < u16(0); i++) {
+        if (pos + 8 > body.size()) {
+            return -1;
+        }
+        uint16_t x = u16(pos);
+        uint16_t y = u16(pos + 2);
+        uint16_t w = u16(pos + 4);
+        uint16_t h = u16(pos + 6);
+        pos += 8;
+        size_t len = size_t(w / 8) * h;
+        if (w == 0 || h == 0 || (x | y | w | h) % 8 != 0 || x + w > FrameWriter::WIDTH ||
+            y + h > FrameWriter::HEIGHT || pos + len > body.size()) {
+            return -1;
+        }
+
+        writer.begin(x, y, w, h);
+        writeChunked(writer, body.data() + pos, len, [chunk] { return chunk; });
+        pos += len;
+        changedStrips += writer.changedStrips();
+    }
+    return pos == body.size() ? changedStrips : -1;
+}
+
+} // namespace HostTest
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "frame_writer.h"
+
+// Responses of the dashboard server, ported from server.ts. Frames are the PBM pixel data
+// without header, FrameWriter::FRAME_BYTES bytes with 1 for black.
+namespace HostTest {
+
+using Bytes = std::vector<uint8_t>;
+
+// compressPBM() without the header
+Bytes packBits(const Bytes& frame);
+// computeDelta() for two frames of the full size
+Bytes delta(const Bytes& base, const Bytes& frame);
+// frameHash(), must match FrameWriter::hash()
+uint32_t frameHash(const Bytes& frame);
+
+// frameChunk(), one multicast datagram with the given chunk of the frame
+Bytes frameChunk(const Bytes& frame, uint32_t hash, uint16_t index);
+
+// Apply a delta body like WeatherDisplay::receiveDelta(), forwarding the pixels of each
+// patch in pieces of at most chunk bytes. Returns the number of changed strips summed over
+// all patches, or -1 for a malformed body.
+int applyDelta(WeatherDisplay::FrameWriter& writer, const Bytes& body, size_t chunk);
+
+// Pass data to sink.write() in pieces whose sizes are given by nextSize(), like reading
+// a response body from the socket
+template <typename Sink, typename NextSize>
+void writeChunked(Sink& sink, const uint8_t* data, size_t len, NextSize nextSize) {
+    while (len > 0) {
+        size_t n = nextSize();
+        if (n == 0 || n > len) {
+            n = len;
+        }
+        sink.write(data, n);
+        data += n;
+        len -= n;
+    }
+}
+
+} // namespace HostTest
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Fetch the fixtures of render_test and the benchmark from a server that shows the fixed
+# values of dashboard.json instead of the Home Assistant values:
+#
+#   cd server && TZ=Europe/Berlin DASHBOARD_DATA_FILE=../display/host_test/fixtures/dashboard.json npm run dev
+#   display/host_test/fixtures/update.sh [http://localhost:3000]
+#
+# Only the icons listed in glyphs.txt are fetched, add new ones there first.
+set -e
+server=${1:-http://localhost:3000}
+cd "$(dirname "$0")"
+
+# The server renders the date of the request time
+date +%s > frame_time
+curl -sf -o dashboard.pbm "$server/dashboard.pbm"
+curl -sf -o dashboard.data "$server/dashboard.data"
+
+while read -r icon size advance; do
+    advance=$(curl -sf -D - -o "glyphs/$icon-$size.pbm" "$server/dashboard.glyph/$icon/$size" |
+              tr -d '\r' | sed -n 's/^[Xx]-[Gg]lyph-[Aa]dvance: //p')
+    echo "$icon $size $advance"
+done < glyphs.txt > glyphs.txt.new
+mv glyphs.txt.new glyphs.txt
+
+# Frames of the benchmark with the values of dashboard_*.json. The server reads the data
+# file on each request, thus each variant replaces dashboard.json while it is fetched.
+cp dashboard.json dashboard.json.orig
+trap 'mv dashboard.json.orig dashboard.json' EXIT
+time=$(cat frame_time)
+for variant in sensor rooms other; do
+    cp "dashboard_$variant.json" dashboard.json
+    # The new dashboard shows the next day
+    frame_time=$time
+    [ "$variant" = other ] && frame_time=$((time + 86400))
+    curl -sf -H "X-Frame-Time: $frame_time" -o "dashboard_$variant.pbm" "$server/dashboard.delta"
+done
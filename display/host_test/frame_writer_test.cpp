@@ -0,0 +1,224 @@
+// Regression test of the frame path: the controller RAM must match the PBM frame for any
+// chunking of the input, after strip diffing, delta patches and PackBits decoding.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "fake_server.h"
+#include "frame_writer.h"
+#include "packbits.h"
+
+using namespace HostTest;
+using WeatherDisplay::FrameWriter;
+using WeatherDisplay::PackBitsDecoder;
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);   \
+            exit(1);                                                                         \
+        }                                                                                    \
+    } while (0)
+
+namespace {
+
+std::mt19937 rng(1);
+GxEPD2_426_GDEQ0426T82Mod epd;
+FrameWriter writer(epd);
+PackBitsDecoder decoder(writer);
+
+// Chunk sizes like socket reads, including single bytes and sizes beyond a strip
+size_t randomChunk() {
+    switch (rng() % 4) {
+    case 0:
+        return 1 + rng() % 7;
+    case 1:
+        return 1 + rng() % FrameWriter::ROW_BYTES;
+    default:
+        return 1 + rng() % 3000;
+    }
+}
+
+// With rotation 3, PBM pixel (x, y) is shown at driver pixel (y, HEIGHT - 1 - x). The PBM
+// uses 1 for black, the controller 1 for white.
+bool ramMatches(const Bytes& frame) {
+    if (epd.controller().invalidWrites() != 0) {
+        return false;
+    }
+    for (uint16_t y = 0; y < FrameWriter::HEIGHT; y++) {
+        for (uint16_t x = 0; x < FrameWriter::WIDTH; x++) {
+            bool black = (frame[y * FrameWriter::ROW_BYTES + x / 8] >> (7 - x % 8)) & 1;
+            if (black == epd.pixel(y, GxEPD2_426_GDEQ0426T82Mod::HEIGHT - 1 - x)) {
+                fprintf(stderr, "pixel (%u, %u) differs\n", x, y);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Bytes randomFrame() {
+    Bytes frame(FrameWriter::FRAME_BYTES);
+    for (auto& b : frame) {
+        b = rng();
+    }
+    return frame;
+}
+
+// Flip a few random pixels, mostly within few strips
+void flipPixels(Bytes& frame, int count) {
+    for (int i = 0; i < count; i++) {
+        frame[rng() % FrameWriter::FRAME_BYTES] ^= 1 << (rng() % 8);
+    }
+}
+
+void writeFrame(const Bytes& frame) {
+    writer.begin();
+    writeChunked(writer, frame.data(), frame.size(), randomChunk);
+    CHECK(writer.complete());
+}
+
+void testRandomChunking() {
+    Bytes frame = randomFrame();
+    for (int i = 0; i < 20; i++) {
+        writer.invalidate();
+        epd.controller().fill(0x00);
+        writeFrame(frame);
+        CHECK(writer.changedStrips() == FrameWriter::STRIPS);
+        CHECK(writer.hash() == frameHash(frame));
+        CHECK(ramMatches(frame));
+    }
+}
+
+void testStripDiffing() {
+    Bytes frame = randomFrame();
+    writer.invalidate();
+    writeFrame(frame);
+
+    // An unchanged frame does not touch the RAM
+    epd.controller().resetCounters();
+    writeFrame(frame);
+    CHECK(writer.changedStrips() == 0);
+    CHECK(epd.controller().ramBytes() == 0);
+
+    // A single pixel only rewrites its 8x8 block
+    frame[123 * FrameWriter::ROW_BYTES + 17] ^= 0x10;
+    epd.controller().resetCounters();
+    writeFrame(frame);
+    CHECK(writer.changedStrips() == 1);
+    CHECK(epd.controller().ramBytes() == 8);
+    CHECK(ramMatches(frame));
+
+    // Changes at both ends of the rows, in strips close to each other and in the last strip
+    for (int i = 0; i < 100; i++) {
+        switch (rng() % 3) {
+        case 0:
+            flipPixels(frame, 1 + rng() % 20);
+            break;
+        case 1: {
+            size_t row = rng() % FrameWriter::HEIGHT;
+            frame[row * FrameWriter::ROW_BYTES] ^= 0x80;
+            frame[row * FrameWriter::ROW_BYTES + FrameWriter::ROW_BYTES - 1] ^= 0x01;
+            break;
+        }
+        default:
+            frame[FrameWriter::FRAME_BYTES - 1 - rng() % (FrameWriter::ROW_BYTES * 8)] ^= rng() | 1;
+            break;
+        }
+        epd.controller().resetCounters();
+        writeFrame(frame);
+        CHECK(epd.controller().ramBytes() < FrameWriter::FRAME_BYTES);
+        CHECK(writer.hash() == frameHash(frame));
+        CHECK(ramMatches(frame));
+    }
+}
+
+void testDeltaPatches() {
+    Bytes base = randomFrame();
+    writer.invalidate();
+    writeFrame(base);
+
+    for (int i = 0; i < 50; i++) {
+        Bytes frame = base;
+        if (i % 2 == 0) {
+            flipPixels(frame, 1 + rng() % 200);
+        } else {
+            // Replace an aligned rectangle, e.g. a new value
+            size_t x = rng() % FrameWriter::ROW_BYTES;
+            size_t y = rng() % FrameWriter::HEIGHT;
+            size_t w = 1 + rng() % (FrameWriter::ROW_BYTES - x);
+            size_t h = 1 + rng() % (FrameWriter::HEIGHT - y);
+            for (size_t row = y; row < y + h; row++) {
+                for (size_t col = x; col < x + w; col++) {
+                    frame[row * FrameWriter::ROW_BYTES + col] = rng();
+                }
+            }
+        }
+
+        Bytes body = delta(base, frame);
+        CHECK(applyDelta(writer, body, randomChunk()) >= 0);
+        CHECK(writer.frameComplete());
+        CHECK(memcmp(writer.frame(), frame.data(), frame.size()) == 0);
+        CHECK(writer.frameHash() == frameHash(frame));
+        CHECK(ramMatches(frame));
+        base = frame;
+    }
+
+    // Patches that do not change the frame copy do not touch the RAM either
+    epd.controller().resetCounters();
+    writer.resetModified();
+    CHECK(applyDelta(writer, delta(base, base), 64) == 0);
+    CHECK(epd.controller().ramBytes() == 0);
+    CHECK(!writer.modified());
+
+    // A download interrupted after the first of two patches leaves the last region
+    // complete, but the RAM no longer matches the base frame
+    Bytes patch(FrameWriter::ROW_BYTES * 8);
+    for (size_t i = 0; i < patch.size(); i++) {
+        patch[i] = ~base[i];
+    }
+    writer.begin(0, 0, FrameWriter::WIDTH, 8);
+    writer.write(patch.data(), patch.size());
+    CHECK(writer.complete());
+    CHECK(writer.modified());
+}
+
+void testPackBits() {
+    // Long runs, literals and runs interrupted by single bytes
+    Bytes frame(FrameWriter::FRAME_BYTES, 0);
+    for (size_t i = 0; i < frame.size(); i++) {
+        size_t row = i / FrameWriter::ROW_BYTES;
+        if (row % 100 < 30) {
+            frame[i] = rng();
+        } else if (row % 100 < 40) {
+            frame[i] = i % 3 == 0 ? 0xFF : 0x00;
+        } else if (row % 100 < 45) {
+            frame[i] = 0xAA;
+        }
+    }
+
+    Bytes encoded = packBits(frame);
+    CHECK(encoded.size() < frame.size());
+    for (int i = 0; i < 20; i++) {
+        writer.invalidate();
+        writer.begin();
+        decoder.begin();
+        writeChunked(decoder, encoded.data(), encoded.size(), randomChunk);
+        CHECK(writer.complete());
+        CHECK(writer.hash() == frameHash(frame));
+        CHECK(memcmp(writer.frame(), frame.data(), frame.size()) == 0);
+        CHECK(ramMatches(frame));
+    }
+}
+
+} // namespace
+
+int main() {
+    testRandomChunking();
+    testStripDiffing();
+    testDeltaPatches();
+    testPackBits();
+    printf("frame_writer_test passed\n");
+    return 0;
+}
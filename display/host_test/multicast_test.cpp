@@ -0,0 +1,242 @@
+// Loopback test of the multicast path: several displays receive the same frames with
+// packet loss, duplicates and reordering, request the missing chunks like
+// WeatherDisplay::receiveMulticast() and must end up with the frame in the controller RAM.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+#include <lwip/sockets.h>
+#include "fake_server.h"
+#include "frame_writer.h"
+#include "multicast_receiver.h"
+
+using namespace HostTest;
+using WeatherDisplay::FrameWriter;
+using WeatherDisplay::MulticastReceiver;
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);   \
+            exit(1);                                                                         \
+        }                                                                                    \
+    } while (0)
+
+namespace {
+
+constexpr const char* GROUP = "239.255.42.1";
+// Each display listens on its own port, such that the sender can drop datagrams per display
+constexpr uint16_t BASE_PORT = 47100;
+// Percentage of datagrams lost on the way to each display
+constexpr int LOSS_PERCENT[] = {0, 5, 10, 20, 40, 70};
+constexpr size_t DISPLAYS = std::size(LOSS_PERCENT);
+constexpr int DUPLICATE_PERCENT = 5;
+
+std::mt19937 rng(1);
+
+struct Display {
+    GxEPD2_426_GDEQ0426T82Mod epd;
+    FrameWriter writer{epd};
+    MulticastReceiver receiver{writer};
+    uint16_t port = 0;
+    int lossPercent = 0;
+};
+
+std::vector<std::unique_ptr<Display>> displays;
+int sender = -1;
+
+Bytes randomFrame() {
+    Bytes frame(FrameWriter::FRAME_BYTES);
+    for (auto& b : frame) {
+        b = rng();
+    }
+    return frame;
+}
+
+// With rotation 3, PBM pixel (x, y) is shown at driver pixel (y, HEIGHT - 1 - x). The PBM
+// uses 1 for black, the controller 1 for white.
+bool ramMatches(const GxEPD2_426_GDEQ0426T82Mod& epd, const Bytes& frame) {
+    if (epd.controller().invalidWrites() != 0) {
+        return false;
+    }
+    for (uint16_t y = 0; y < FrameWriter::HEIGHT; y++) {
+        for (uint16_t x = 0; x < FrameWriter::WIDTH; x++) {
+            bool black = (frame[y * FrameWriter::ROW_BYTES + x / 8] >> (7 - x % 8)) & 1;
+            if (black == epd.pixel(y, GxEPD2_426_GDEQ0426T82Mod::HEIGHT - 1 - x)) {
+                fprintf(stderr, "pixel (%u, %u) differs\n", x, y);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool loadPacket(MulticastReceiver& receiver, const Bytes& packet) {
+    memcpy(receiver.packet(), packet.data(), packet.size());
+    return receiver.handlePacket(packet.size());
+}
+
+void send(const Display& display, const Bytes& packet) {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(display.port);
+    addr.sin_addr.s_addr = inet_addr(GROUP);
+    CHECK(sendto(sender, packet.data(), packet.size(), 0, (struct sockaddr*)&addr, sizeof(addr)) ==
+          (ssize_t)packet.size());
+}
+
+// Send the given chunks of the frame in random order, each display loses some of them
+void multicast(const Bytes& frame, uint32_t hash, uint16_t chunks, bool lossy) {
+    std::vector<uint16_t> order(chunks);
+    for (uint16_t i = 0; i < chunks; i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+    for (uint16_t index : order) {
+        Bytes packet = frameChunk(frame, hash, index);
+        for (const auto& display : displays) {
+            if (lossy && int(rng() % 100) < display->lossPercent) {
+                continue;
+            }
+            send(*display, packet);
+            if (lossy && int(rng() % 100) < DUPLICATE_PERCENT) {
+                send(*display, packet);
+            }
+        }
+    }
+}
+
+// Receive the frame like WeatherDisplay::receiveMulticast() and check the controller RAM.
+// Returns the number of changed strips.
+uint16_t receive(Display& display, const Bytes& frame, uint32_t hash, uint32_t knownHash) {
+    MulticastReceiver& receiver = display.receiver;
+    CHECK(receiver.waitForFrame(knownHash, 1000));
+    receiver.receive(50);
+    CHECK(receiver.hash() == hash);
+
+    uint16_t requested = 0;
+    for (uint16_t i = receiver.nextMissing(0); i < receiver.count(); i = receiver.nextMissing(i + 1)) {
+        CHECK(loadPacket(receiver, frameChunk(frame, hash, i)));
+        requested++;
+    }
+    // Without loss, the datagrams alone complete the frame
+    CHECK(display.lossPercent > 0 || requested == 0);
+    CHECK(receiver.complete());
+    CHECK(display.writer.frameComplete());
+    CHECK(display.writer.frameHash() == hash);
+    CHECK(ramMatches(display.epd, frame));
+    uint16_t changedStrips = receiver.changedStrips();
+    receiver.reset();
+    return changedStrips;
+}
+
+void testInvalidPackets() {
+    Display display;
+    MulticastReceiver& receiver = display.receiver;
+    Bytes frame = randomFrame();
+    uint32_t hash = frameHash(frame);
+    Bytes valid = frameChunk(frame, hash, 3);
+    CHECK(valid.size() == MulticastReceiver::PACKET_BYTES);
+
+    // The buffer still holds a valid packet, only the length tells that the new one is short
+    for (size_t len = 0; len < MulticastReceiver::PACKET_BYTES;
+         len += len < MulticastReceiver::HEADER_BYTES ? 1 : 97) {
+        memcpy(receiver.packet(), valid.data(), valid.size());
+        CHECK(!receiver.handlePacket(len));
+    }
+    CHECK(!receiver.pending());
+
+    auto corrupted = [&](size_t pos, uint8_t value) {
+        Bytes packet = valid;
+        packet[pos] = value;
+        return packet;
+    };
+    // Magic, chunk index, chunk count and checksum
+    CHECK(!loadPacket(receiver, corrupted(0, 0)));
+    CHECK(!loadPacket(receiver, corrupted(9, 0xFF)));
+    CHECK(!loadPacket(receiver, corrupted(10, MulticastReceiver::CHUNKS + 1)));
+    CHECK(!loadPacket(receiver, corrupted(MulticastReceiver::HEADER_BYTES, ~valid[MulticastReceiver::HEADER_BYTES])));
+    CHECK(!receiver.pending());
+
+    CHECK(loadPacket(receiver, valid));
+    CHECK(receiver.pending() && receiver.hash() == hash && receiver.nextMissing(0) == 0);
+    CHECK(receiver.nextMissing(3) == 4);
+}
+
+void testLossyLoopback() {
+    for (size_t i = 0; i < DISPLAYS; i++) {
+        auto display = std::make_unique<Display>();
+        display->port = BASE_PORT + i;
+        display->lossPercent = LOSS_PERCENT[i];
+        if (!display->receiver.begin(GROUP, display->port)) {
+            // E.g. a sandbox without multicast route
+            printf("multicast not available, skipping the loopback test\n");
+            displays.clear();
+            return;
+        }
+        displays.push_back(std::move(display));
+    }
+
+    sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK(sender >= 0);
+    // Deliver the datagrams to this host only
+    unsigned char ttl = 0;
+    unsigned char loop = 1;
+    CHECK(setsockopt(sender, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == 0);
+    CHECK(setsockopt(sender, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == 0);
+
+    // A new dashboard on displays that show nothing yet
+    Bytes frame = randomFrame();
+    uint32_t hash = frameHash(frame);
+    multicast(frame, hash, MulticastReceiver::CHUNKS, true);
+    for (auto& display : displays) {
+        display->writer.invalidate();
+        CHECK(receive(*display, frame, hash, 0) == FrameWriter::STRIPS);
+    }
+
+    for (int round = 0; round < 10; round++) {
+        Bytes next = frame;
+        for (int i = 0; i < 20; i++) {
+            next[rng() % next.size()] ^= 1 << (rng() % 8);
+        }
+        uint32_t nextHash = frameHash(next);
+
+        // A frame sent again for other displays is ignored by those that show it. Only a
+        // few chunks are sent in addition, the socket buffers hold about 100 datagrams.
+        if (round % 3 == 0) {
+            multicast(frame, hash, MulticastReceiver::CHUNKS / 5, false);
+        }
+        // A newer frame replaces an incomplete one
+        if (round % 3 == 1) {
+            Bytes stale = randomFrame();
+            multicast(stale, frameHash(stale), MulticastReceiver::CHUNKS / 5, false);
+        }
+        multicast(next, nextHash, MulticastReceiver::CHUNKS, true);
+        for (auto& display : displays) {
+            // The stale frame may have changed further strips
+            CHECK(receive(*display, next, nextHash, hash) > 0);
+        }
+        frame = next;
+        hash = nextHash;
+    }
+
+    close(sender);
+    for (auto& display : displays) {
+        display->receiver.logStats();
+        display->receiver.end();
+    }
+    displays.clear();
+}
+
+} // namespace
+
+int main() {
+    testInvalidPackets();
+    testLossyLoopback();
+    printf("multicast_test passed\n");
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "ssd1677.h"
+#include <cstring>
+
+namespace HostTest {
+
+void Ssd1677::command(uint8_t command) {
+    command_ = command;
+    paramCount_ = 0;
+    transactions_++;
+    commands_++;
+}
+
+void Ssd1677::data(const uint8_t* data, size_t len) {
+    transactions_++;
+    dataBytes_ += len;
+    for (size_t i = 0; i < len; i++) {
+        if (command_ == 0x24) {
+            ramWrite(data[i]);
+        } else {
+            parameter(data[i]);
+        }
+    }
+}
+
+void Ssd1677::fill(uint8_t value) {
+    memset(ram_, value, sizeof(ram_));
+}
+
+void Ssd1677::resetCounters() {
+    transactions_ = 0;
+    commands_ = 0;
+    dataBytes_ = 0;
+    ramBytes_ = 0;
+    invalidWrites_ = 0;
+}
+
+void Ssd1677::parameter(uint8_t value) {
+    if (paramCount_ < sizeof(params_)) {
+        params_[paramCount_] = value;
+    }
+    paramCount_++;
+
+    switch (command_) {
+    case 0x11: // data entry mode
+        entryMode_ = value & 0x07;
+        break;
+    case 0x44: // RAM x start and end
+        if (paramCount_ == 4) {
+            xStart_ = param16(0);
+            xEnd_ = param16(2);
+        }
+        break;
+    case 0x45: // RAM y start and end
+        if (paramCount_ == 4) {
+            yStart_ = param16(0);
+            yEnd_ = param16(2);
+        }
+        break;
+    case 0x4e: // RAM x address counter
+        if (paramCount_ == 2) {
+            x_ = param16(0);
+        }
+        break;
+    case 0x4f: // RAM y address counter
+        if (paramCount_ == 2) {
+            y_ = param16(0);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void Ssd1677::ramWrite(uint8_t value) {
+    ramBytes_++;
+    if (x_ % 8 != 0 || x_ >= RAM_WIDTH || y_ >= RAM_HEIGHT) {
+        invalidWrites_++;
+    } else {
+        ram_[y_][x_ / 8] = value;
+    }
+
+    // The counters wrap around within the window, from start to end in the direction
+    // given by the entry mode
+    bool xIncrement = entryMode_ & 0x01;
+    bool yIncrement = entryMode_ & 0x02;
+    bool xAtEnd = xIncrement ? x_ + 8 > xEnd_ : x_ < xEnd_ + 8;
+    bool yAtEnd = y_ == yEnd_;
+    if (entryMode_ & 0x04) {
+        if (!yAtEnd) {
+            y_ = yIncrement ? y_ + 1 : y_ - 1;
+            return;
+        }
+        y_ = yStart_;
+        x_ = xAtEnd ? xStart_ : (xIncrement ? x_ + 8 : x_ - 8);
+    } else {
+        if (!xAtEnd) {
+            x_ = xIncrement ? x_ + 8 : x_ - 8;
+            return;
+        }
+        x_ = xStart_;
+        y_ = yAtEnd ? yStart_ : (yIncrement ? y_ + 1 : y_ - 1);
+    }
+}
+
+} // namespace HostTest
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace HostTest {
+
+// Model of the SSD1677 controller as far as the display driver uses it: the data entry
+// mode, the RAM window and address counters, and writing the black/white RAM with
+// command 0x24. All other commands are only counted along with their parameters.
+class Ssd1677 {
+public:
+    // RAM size used by the panel, x in pixels along the sources and y along the gates
+    static constexpr uint16_t RAM_WIDTH = 800;
+    static constexpr uint16_t RAM_HEIGHT = 480;
+    static constexpr size_t RAM_ROW_BYTES = RAM_WIDTH / 8;
+
+    Ssd1677() { fill(0xFF); }
+
+    // Each call corresponds to one SPI transaction of the driver
+    void command(uint8_t command);
+    void data(const uint8_t* data, size_t len);
+
+    // RAM content with 1 for white, row y contains RAM_ROW_BYTES bytes
+    const uint8_t* ramRow(uint16_t y) const { return ram_[y]; }
+    bool ramPixel(uint16_t x, uint16_t y) const { return (ram_[y][x / 8] >> (7 - x % 8)) & 1; }
+    void fill(uint8_t value);
+
+    uint32_t transactions() const { return transactions_; }
+    uint32_t commands() const { return commands_; }
+    // All bytes sent with DC high, including command parameters
+    uint32_t dataBytes() const { return dataBytes_; }
+    // Bytes written to the RAM
+    uint32_t ramBytes() const { return ramBytes_; }
+    // Writes outside of the RAM or not aligned to 8 pixels, always 0 for a correct driver
+    uint32_t invalidWrites() const { return invalidWrites_; }
+    void resetCounters();
+
+private:
+    void parameter(uint8_t value);
+    void ramWrite(uint8_t value);
+    uint16_t param16(size_t index) const { return params_[index] | (params_[index + 1] << 8); }
+
+    uint8_t command_ = 0;
+    uint8_t params_[4] = {};
+    size_t paramCount_ = 0;
+
+    // Bit 0 set: x increments, bit 1 set: y increments, bit 2 set: y is updated first
+    uint8_t entryMode_ = 0x03;
+    uint16_t xStart_ = 0;
+    uint16_t xEnd_ = RAM_WIDTH - 1;
+    uint16_t yStart_ = 0;
+    uint16_t yEnd_ = RAM_HEIGHT - 1;
+    uint16_t x_ = 0;
+    uint16_t y_ = 0;
+    uint8_t ram_[RAM_HEIGHT][RAM_ROW_BYTES];
+
+    uint32_t transactions_ = 0;
+    uint32_t commands_ = 0;
+    uint32_t dataBytes_ = 0;
+    uint32_t ramBytes_ = 0;
+    uint32_t invalidWrites_ = 0;
+};
+
+} // namespace HostTest
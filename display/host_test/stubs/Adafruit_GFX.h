@@ -0,0 +1,6 @@
+#pragma once
+
+// Host replacement of the Adafruit GFX library header, the fonts only need the types
+#include <gfxfont.h>
+
+#define PROGMEM
@@ -0,0 +1,84 @@
+#include "GxEPD2_426_GDEQ0426T82Mod.h"
+
+// The window calculations are the ones of components/GxEPD2/src/GxEPD2_426_GDEQ0426T82Mod.cpp
+
+void GxEPD2_426_GDEQ0426T82Mod::writeImage(const uint8_t bitmap[], int16_t x, int16_t y, int16_t w, int16_t h,
+                                           bool invert, bool mirror_y, bool pgm) {
+    (void)pgm;
+    int16_t wb = (w + 7) / 8; // width bytes, bitmaps are padded
+    x -= x % 8; // byte boundary
+    w = wb * 8; // byte boundary
+    int16_t x1 = x < 0 ? 0 : x; // limit
+    int16_t y1 = y < 0 ? 0 : y; // limit
+    int16_t w1 = x + w < int16_t(WIDTH) ? w : int16_t(WIDTH) - x; // limit
+    int16_t h1 = y + h < int16_t(HEIGHT) ? h : int16_t(HEIGHT) - y; // limit
+    int16_t dx = x1 - x;
+    int16_t dy = y1 - y;
+    w1 -= dx;
+    h1 -= dy;
+    if ((w1 <= 0) || (h1 <= 0)) return;
+    setPartialRamArea(x1, y1, w1, h1);
+    writeCommand(0x24);
+    if (!mirror_y && (w1 == w)) {
+        transferBytes(&bitmap[int32_t(dy) * wb], uint32_t(wb) * h1, invert);
+    } else {
+        for (int16_t i = 0; i < h1; i++) {
+            int32_t idx = mirror_y ? dx / 8 + ((h - 1 - int32_t(i + dy))) * wb : dx / 8 + int32_t(i + dy) * wb;
+            transferBytes(&bitmap[idx], w1 / 8, invert);
+        }
+    }
+}
+
+void GxEPD2_426_GDEQ0426T82Mod::writeScreenBuffer(uint8_t value) {
+    setPartialRamArea(0, 0, WIDTH, HEIGHT);
+    writeCommand(0x24);
+    uint8_t row[WIDTH / 8];
+    for (auto& b : row) {
+        b = value;
+    }
+    for (uint16_t i = 0; i < HEIGHT; i++) {
+        controller_.data(row, sizeof(row));
+    }
+    ram_bytes_written_ += uint32_t(HEIGHT) * sizeof(row);
+}
+
+void GxEPD2_426_GDEQ0426T82Mod::transferBytes(const uint8_t data[], uint32_t n, bool invert) {
+    ram_bytes_written_ += n;
+    if (!invert) {
+        controller_.data(data, n);
+        return;
+    }
+    uint8_t chunk[WIDTH / 8];
+    while (n > 0) {
+        uint32_t len = n < sizeof(chunk) ? n : sizeof(chunk);
+        for (uint32_t j = 0; j < len; j++) {
+            chunk[j] = ~data[j];
+        }
+        controller_.data(chunk, len);
+        data += len;
+        n -= len;
+    }
+}
+
+void GxEPD2_426_GDEQ0426T82Mod::setPartialRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    // gates are reversed on this display, reverse data entry on y
+    y = HEIGHT - y - h; // reversed partial window
+    writeCommand(0x11); // set ram entry mode
+    writeData(0x01);    // x increase, y decrease : y reversed
+    writeCommand(0x44);
+    writeData(x % 256);
+    writeData(x / 256);
+    writeData((x + w - 1) % 256);
+    writeData((x + w - 1) / 256);
+    writeCommand(0x45);
+    writeData((y + h - 1) % 256);
+    writeData((y + h - 1) / 256);
+    writeData(y % 256);
+    writeData(y / 256);
+    writeCommand(0x4e);
+    writeData(x % 256);
+    writeData(x / 256);
+    writeCommand(0x4f);
+    writeData((y + h - 1) % 256);
+    writeData((y + h - 1) / 256);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include "ssd1677.h"
+
+// Host replacement of the display driver. It issues the same command sequence as the real
+// driver, but the SPI transfers go to an emulated SSD1677 instead of the panel.
+class GxEPD2_426_GDEQ0426T82Mod {
+public:
+    static const uint16_t WIDTH = 800;
+    static const uint16_t HEIGHT = 480;
+
+    // write to controller memory, x and w should be multiple of 8
+    void writeImage(const uint8_t bitmap[], int16_t x, int16_t y, int16_t w, int16_t h, bool invert = false,
+                    bool mirror_y = false, bool pgm = false);
+    // init controller memory (default white)
+    void writeScreenBuffer(uint8_t value = 0xFF);
+    // number of pixel data bytes sent to the controller RAM, wraps around
+    uint32_t ramBytesWritten() const { return ram_bytes_written_; }
+
+    HostTest::Ssd1677& controller() { return controller_; }
+    const HostTest::Ssd1677& controller() const { return controller_; }
+    // Pixel in driver coordinates as shown on the panel, true for white
+    bool pixel(uint16_t x, uint16_t y) const { return controller_.ramPixel(x, HEIGHT - 1 - y); }
+
+private:
+    void writeCommand(uint8_t command) { controller_.command(command); }
+    void writeData(uint8_t value) { controller_.data(&value, 1); }
+    void transferBytes(const uint8_t data[], uint32_t n, bool invert);
+    void setPartialRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+    HostTest::Ssd1677 controller_;
+    uint32_t ram_bytes_written_ = 0;
+};
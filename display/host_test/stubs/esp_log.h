@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdio>
+
+// Host replacement of the ESP-IDF logging, prints warnings and errors only
+#define HOST_LOG(letter, tag, format, ...) fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ((void)(tag))
+#define ESP_LOGD(tag, format, ...) ((void)(tag))
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Host replacement of the ESP-IDF timer, microseconds since an arbitrary start
+inline int64_t esp_timer_get_time() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// The lwIP socket API follows BSD sockets, thus the host provides it
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
@@ -0,0 +1,3 @@
+#pragma once
+
+// Host builds use the defaults of all Kconfig options, thus phase tracing is disabled
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <pins_arduino.h>
+#include "sdkconfig.h"
 
 // Pin definitions
 constexpr auto TFT_SCLK = D8;
@@ -10,5 +11,7 @@ constexpr auto TFT_CS = D1;
 constexpr auto TFT_DC = D3;
 constexpr auto TFT_BUSY = D2;
 constexpr auto TFT_RST = D0;
-constexpr auto SPI_FREQUENCY = 10000000;
+// SPI clock for the display, see CONFIG_DISPLAY_SPI_FREQUENCY. The driver applies it to
+// each SPI transaction via the SPISettings passed to selectSPI().
+constexpr auto SPI_FREQUENCY = CONFIG_DISPLAY_SPI_FREQUENCY;
 constexpr auto TFT_SPI_MODE = SPI_MODE0;
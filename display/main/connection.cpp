@@ -0,0 +1,143 @@
+#include "connection.h"
+#include <algorithm>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <strings.h>
+#include <phase_trace.h>
+
+namespace WeatherDisplay {
+
+static const char* TAG = "connection";
+
+// Log a summary roughly once per hour
+constexpr uint32_t STATS_LOG_INTERVAL = 60;
+
+DashboardConnection::DashboardConnection(const char* server) : server_(server) {
+    http_.setReuse(true);
+    http_.setConnectTimeout(CONNECT_TIMEOUT_MS);
+
+    const char* colon = strchr(server, ':');
+    int hostLen = colon ? colon - server : strlen(server);
+    snprintf(host_, sizeof(host_), "%.*s", hostLen, server);
+    port_ = colon ? atoi(colon + 1) : 80;
+}
+
+void DashboardConnection::begin(const char* path, uint32_t extraTimeoutMs) {
+    snprintf(url_, sizeof(url_), "http://%s%s", server_, path);
+    http_.begin(client_, url_);
+    http_.setTimeout(TIMEOUT_MS + extraTimeoutMs);
+}
+
+void DashboardConnection::collectHeaders(const char* names[], size_t count) {
+    headerNames_ = names;
+    headerCount_ = std::min(count, MAX_HEADERS);
+    http_.collectHeaders(names, headerCount_);
+}
+
+int DashboardConnection::get() {
+    bool reused = client_.connected();
+    int64_t start = esp_timer_get_time();
+
+    bool connected = reused;
+    if (!reused) {
+        // Connect separately to tell the handshake apart from the request, HTTPClient
+        // reuses the open connection
+        PHASE_TRACE_SCOPE(HTTP_CONNECT);
+        connected = client_.connect(host_, port_, CONNECT_TIMEOUT_MS);
+    }
+    int httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+    if (connected) {
+        PHASE_TRACE_SCOPE(HTTP_HEADERS);
+        httpCode = http_.GET();
+    }
+    // A connection closed by the server while idle fails as soon as the request is sent.
+    // A read timeout means the server received the request, sending it again would block
+    // once more for the full timeout.
+    bool closed = httpCode == HTTPC_ERROR_SEND_HEADER_FAILED || httpCode == HTTPC_ERROR_NOT_CONNECTED ||
+                  httpCode == HTTPC_ERROR_CONNECTION_LOST;
+    if (reused && closed && esp_timer_get_time() - start < RETRY_WINDOW_MS * 1000LL) {
+        // Retry once with a new connection. HTTPClient keeps the request headers and
+        // reconnects automatically.
+        stats_.reconnects++;
+        reused = false;
+        client_.stop();
+        httpCode = http_.GET();
+    }
+
+    copyHeaders();
+
+    uint32_t latencyMs = (esp_timer_get_time() - start) / 1000;
+    stats_.requests++;
+    if (reused) {
+        stats_.reused++;
+    }
+    stats_.lastLatencyMs = latencyMs;
+    stats_.maxLatencyMs = std::max(stats_.maxLatencyMs, latencyMs);
+    stats_.totalLatencyMs += latencyMs;
+
+    ESP_LOGD(TAG, "GET %d, %s connection, %lu ms", httpCode, reused ? "reused" : "new", (unsigned long)latencyMs);
+    if (stats_.requests % STATS_LOG_INTERVAL == 0) {
+        logStats();
+    }
+    return httpCode;
+}
+
+size_t DashboardConnection::waitForData() {
+    int available = client_.available();
+    if (available > 0 || !client_.connected()) {
+        return available > 0 ? available : 0;
+    }
+
+    // Sleep until the socket becomes readable instead of polling
+    int fd = client_.fd();
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(fd, &readSet);
+    struct timeval timeout = {TIMEOUT_MS / 1000, (TIMEOUT_MS % 1000) * 1000};
+    if (select(fd + 1, &readSet, nullptr, nullptr, &timeout) <= 0) {
+        return 0;
+    }
+
+    // Either data has arrived or the server closed the connection
+    available = client_.available();
+    return available > 0 ? available : 0;
+}
+
+const char* DashboardConnection::header(const char* name) const {
+    for (size_t i = 0; i < headerCount_; i++) {
+        if (strcasecmp(headerNames_[i], name) == 0) {
+            return headerValues_[i];
+        }
+    }
+    return "";
+}
+
+void DashboardConnection::copyHeaders() {
+    // HTTPClient keeps the collected headers in the order of their names. The String is a
+    // temporary, no allocation outlives this call.
+    for (size_t i = 0; i < headerCount_; i++) {
+        strlcpy(headerValues_[i], http_.header(i).c_str(), MAX_HEADER_BYTES);
+    }
+}
+
+void DashboardConnection::end(bool complete) {
+    if (!complete) {
+        client_.stop();
+    }
+    http_.end();
+}
+
+void DashboardConnection::close() {
+    client_.stop();
+}
+
+void DashboardConnection::logStats() const {
+    ESP_LOGI(TAG, "%lu requests, %lu%% reused, %lu reconnects, latency avg %lu ms, max %lu ms",
+             (unsigned long)stats_.requests, (unsigned long)(stats_.reused * 100 / stats_.requests),
+             (unsigned long)stats_.reconnects, (unsigned long)(stats_.totalLatencyMs / stats_.requests),
+             (unsigned long)stats_.maxLatencyMs);
+}
+
+} // namespace WeatherDisplay
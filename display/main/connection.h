@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <HTTPClient.h>
+#include <WiFiClient.h>
+
+namespace WeatherDisplay {
+
+struct ConnectionStats {
+    uint32_t requests = 0;
+    // requests sent over an already open connection
+    uint32_t reused = 0;
+    // reused connections that turned out to be closed by the server
+    uint32_t reconnects = 0;
+    // time until the response headers were received
+    uint32_t lastLatencyMs = 0;
+    uint32_t maxLatencyMs = 0;
+    uint64_t totalLatencyMs = 0;
+};
+
+// Long-lived HTTP/1.1 connection to the dashboard server.
+//
+// The connection is kept open between requests, which avoids the TCP handshake and
+// DNS lookup on each refresh. If the server has closed the idle connection in the
+// meantime, the request is transparently retried over a new connection. Only requests
+// that fail right away are retried, a timed out request is not sent again.
+class DashboardConnection {
+public:
+    // server is "host" or "host:port", the string must outlive the connection
+    explicit DashboardConnection(const char* server);
+
+    // Prepare a request for the given path. Request headers can be added via http()
+    // afterwards. Requests held back by the server need an additional timeout.
+    void begin(const char* path, uint32_t extraTimeoutMs = 0);
+    // Response headers to keep for the next request, call after begin(). The names must
+    // remain valid until the next call.
+    void collectHeaders(const char* names[], size_t count);
+    // Send a GET request and receive the response headers. Returns the HTTP status
+    // code or a negative HTTPClient error.
+    int get();
+    // Upper limit for the time get() blocks, including connecting and the retry
+    static constexpr uint32_t maxBlockingMs(uint32_t extraTimeoutMs) {
+        return RETRY_WINDOW_MS + CONNECT_TIMEOUT_MS + TIMEOUT_MS + extraTimeoutMs;
+    }
+    // Value of a collected response header, empty if the response did not contain it.
+    // The values are copied into fixed buffers, thus reading them does not allocate.
+    const char* header(const char* name) const;
+    bool hasHeader(const char* name) const { return header(name)[0] != '\0'; }
+    bool headerEquals(const char* name, const char* value) const { return strcmp(header(name), value) == 0; }
+    // Block until response data is available or the connection is closed. Returns the
+    // number of available bytes, which is 0 on timeout or if the server closed the
+    // connection.
+    size_t waitForData();
+    // Finish the request. If the response body was not read completely, the
+    // connection must be closed as the remaining data would corrupt the next response.
+    void end(bool complete);
+    // Close the connection, the next request opens a new one
+    void close();
+
+    HTTPClient& http() { return http_; }
+    WiFiClient* stream() { return http_.getStreamPtr(); }
+    const ConnectionStats& stats() const { return stats_; }
+
+private:
+    // The dashboard takes roughly 1 second to render on the server
+    static constexpr uint32_t TIMEOUT_MS = 10000;
+    // The server is on the local network
+    static constexpr uint32_t CONNECT_TIMEOUT_MS = 3000;
+    // A connection closed by the server while idle fails this fast
+    static constexpr uint32_t RETRY_WINDOW_MS = 1000;
+    static constexpr size_t MAX_HEADERS = 8;
+    // Longest value kept, e.g. a weak ETag with a SHA-1 hash needs 45 bytes
+    static constexpr size_t MAX_HEADER_BYTES = 64;
+
+    void copyHeaders();
+    void logStats() const;
+
+    const char* server_;
+    char url_[96];
+    // server_ split into host and port
+    char host_[48];
+    uint16_t port_;
+    WiFiClient client_;
+    HTTPClient http_;
+    ConnectionStats stats_;
+    const char** headerNames_ = nullptr;
+    size_t headerCount_ = 0;
+    char headerValues_[MAX_HEADERS][MAX_HEADER_BYTES] = {};
+};
+
+} // namespace WeatherDisplay
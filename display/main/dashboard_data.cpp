@@ -0,0 +1,82 @@
+#include "dashboard_data.h"
+#include <algorithm>
+#include <cstring>
+
+namespace WeatherDisplay {
+
+namespace {
+
+// Sequential reader that fails once the payload is exhausted
+class PayloadReader {
+public:
+    PayloadReader(const uint8_t* data, size_t len) : data_(data), len_(len) {}
+
+    bool ok() const { return ok_; }
+
+    uint8_t u8() {
+        if (pos_ + 1 > len_) {
+            ok_ = false;
+            return 0;
+        }
+        return data_[pos_++];
+    }
+
+    int16_t i16() {
+        if (pos_ + 2 > len_) {
+            ok_ = false;
+            return 0;
+        }
+        int16_t value = data_[pos_] | (data_[pos_ + 1] << 8);
+        pos_ += 2;
+        return value;
+    }
+
+    void string(char* out, size_t size) {
+        size_t n = u8();
+        if (pos_ + n > len_) {
+            ok_ = false;
+            n = 0;
+        }
+        size_t copied = std::min(n, size - 1);
+        memcpy(out, data_ + pos_, copied);
+        out[copied] = '\0';
+        pos_ += n;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t len_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+} // namespace
+
+bool DashboardData::parse(const uint8_t* data, size_t len) {
+    PayloadReader reader(data, len);
+    if (reader.u8() != VERSION) {
+        return false;
+    }
+    reader.string(weatherIcon, sizeof(weatherIcon));
+    reader.string(sunrise, sizeof(sunrise));
+    reader.string(sunset, sizeof(sunset));
+
+    uint8_t count = reader.u8();
+    roomCount = 0;
+    for (uint8_t i = 0; i < count && reader.ok(); i++) {
+        Room room;
+        reader.string(room.title, sizeof(room.title));
+        room.temperature = reader.i16();
+        room.humidity = reader.i16();
+        room.dewPoint = reader.i16();
+        room.min = reader.i16();
+        room.max = reader.i16();
+        room.battery = static_cast<int8_t>(reader.u8());
+        if (roomCount < MAX_ROOMS) {
+            rooms[roomCount++] = room;
+        }
+    }
+    return reader.ok();
+}
+
+} // namespace WeatherDisplay
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace WeatherDisplay {
+
+// Values shown on the dashboard, as provided by the server for rendering on the display.
+//
+// The payload is binary with little endian numbers, see encodeDashboardData() in the server:
+//   u8 version, string weather icon, string sunrise, string sunset, u8 room count
+//   per room: string title, i16 temperature, humidity, dew point, min, max, i8 battery
+// Strings consist of a u8 length followed by Latin-1 characters. Measurements are in
+// tenths, NO_VALUE if unknown. The battery level is in percent, or negative if unknown.
+struct DashboardData {
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t MAX_ROOMS = 6;
+    static constexpr int16_t NO_VALUE = INT16_MIN;
+
+    struct Room {
+        char title[28];
+        int16_t temperature;
+        int16_t humidity;
+        int16_t dewPoint;
+        int16_t min;
+        int16_t max;
+        int8_t battery;
+    };
+
+    // FontAwesome icon name without the fa- prefix
+    char weatherIcon[32];
+    // Local times formatted as HH:MM, empty if unknown
+    char sunrise[8];
+    char sunset[8];
+    uint8_t roomCount;
+    Room rooms[MAX_ROOMS];
+
+    // Returns false if the payload is malformed. Rooms beyond MAX_ROOMS and overlong
+    // strings are truncated.
+    bool parse(const uint8_t* data, size_t len);
+};
+
+} // namespace WeatherDisplay
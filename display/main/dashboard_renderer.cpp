@@ -0,0 +1,423 @@
+#include "dashboard_renderer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <Fonts/FreeSans18pt7b.h>
+#include <Fonts/FreeSansBold12pt7b.h>
+#include <Fonts/FreeSansBold18pt7b.h>
+#include <Fonts/FreeSansBold24pt7b.h>
+
+namespace WeatherDisplay {
+
+// CSS of generateHtml() in dashboardTemplate.ts, in pixels
+constexpr int16_t PADDING_X = 15;
+constexpr int16_t PADDING_Y = 5;
+constexpr int16_t CONTENT_WIDTH = FrameWriter::WIDTH - 2 * PADDING_X;
+constexpr int16_t SPACING_SMALL = 5;
+constexpr int16_t SPACING_MEDIUM = 8;
+constexpr int16_t SPACING_XLARGE = 15;
+constexpr int16_t ROOM_PADDING = 2;
+constexpr int16_t ROOM_BORDER = 2;
+constexpr int16_t ROOM_TITLE_MARGIN = -12;
+constexpr uint16_t WEATHER_ICON_SIZE = 100;
+constexpr uint16_t FONT_SIZE_MEDIUM = 26;
+constexpr uint16_t FONT_SIZE_LARGE = 32;
+constexpr uint16_t FONT_SIZE_HUGE = 56;
+
+// Closest Adafruit GFX fonts, these are converted at 141 dpi. The huge font is smaller than
+// in the browser as there is no larger font.
+static const GFXfont* const FONT_MEDIUM_BOLD = &FreeSansBold12pt7b;
+static const GFXfont* const FONT_LARGE = &FreeSans18pt7b;
+static const GFXfont* const FONT_XXLARGE_BOLD = &FreeSansBold18pt7b;
+static const GFXfont* const FONT_HUGE_BOLD = &FreeSansBold24pt7b;
+
+// Latin-1 characters used in the dashboard, the fonts only cover 7 bit ASCII
+constexpr uint8_t DEGREE_SIGN = 0xB0;
+
+static const char* const WEEKDAYS[] = {"Sonntag", "Montag", "Dienstag", "Mittwoch",
+                                       "Donnerstag", "Freitag", "Samstag"};
+static const char* const MONTHS[] = {"Januar", "Februar", "M\xE4rz", "April", "Mai", "Juni", "Juli",
+                                     "August", "September", "Oktober", "November", "Dezember"};
+
+// Umlauts are drawn as their base character with two dots above
+static uint8_t baseCharacter(uint8_t c, bool& umlaut) {
+    static const char UMLAUTS[] = "\xE4\xF6\xFC\xC4\xD6\xDC";
+    static const char BASES[] = "aouAOU";
+    const char* found = c != 0 ? strchr(UMLAUTS, c) : nullptr;
+    umlaut = found != nullptr;
+    return umlaut ? BASES[found - UMLAUTS] : c;
+}
+
+static const GFXglyph* findGlyph(const GFXfont* font, uint8_t c) {
+    if (c < font->first || c > font->last) {
+        return nullptr;
+    }
+    return &font->glyph[c - font->first];
+}
+
+// Format tenths with one decimal like toFixed(1)
+static void formatTenths(char* buf, size_t len, int16_t value, const char* unit) {
+    if (value == DashboardData::NO_VALUE) {
+        snprintf(buf, len, "NaN%s", unit);
+        return;
+    }
+    int magnitude = abs(value);
+    snprintf(buf, len, "%s%d.%d%s", value < 0 ? "-" : "", magnitude / 10, magnitude % 10, unit);
+}
+
+static const char* batteryIcon(int8_t level) {
+    if (level >= 87) {
+        return "battery-full";
+    }
+    if (level >= 63) {
+        return "battery-three-quarters";
+    }
+    if (level >= 37) {
+        return "battery-half";
+    }
+    if (level >= 12) {
+        return "battery-quarter";
+    }
+    return "battery-empty";
+}
+
+bool DashboardRenderer::layout(const DashboardData& data, const struct tm& time) {
+    itemCount_ = 0;
+    overflow_ = false;
+    missingIcon_[0] = '\0';
+    int16_t y = PADDING_Y;
+
+    // Header with the weather icon next to the date and the sun times
+    bool sunTimes = data.sunrise[0] != '\0' && data.sunset[0] != '\0';
+    const GlyphCache::Glyph* weather = icon(data.weatherIcon, WEATHER_ICON_SIZE);
+    const GlyphCache::Glyph* sun = sunTimes ? icon("sun", FONT_SIZE_LARGE) : nullptr;
+    const GlyphCache::Glyph* moon = sunTimes ? icon("moon", FONT_SIZE_LARGE) : nullptr;
+    if (missingIcon_[0] != '\0') {
+        return false;
+    }
+
+    char date[24];
+    const char* weekday = WEEKDAYS[time.tm_wday % 7];
+    snprintf(date, sizeof(date), "%d. %s", time.tm_mday, MONTHS[time.tm_mon % 12]);
+    Piece sunrise[] = {{sun, nullptr, nullptr}, {nullptr, FONT_LARGE, data.sunrise}};
+    Piece sunset[] = {{moon, nullptr, nullptr}, {nullptr, FONT_LARGE, data.sunset}};
+    int16_t sunriseWidth = sunTimes ? runWidth(sunrise, 2, SPACING_SMALL) : 0;
+    int16_t sunsetWidth = sunTimes ? runWidth(sunset, 2, SPACING_SMALL) : 0;
+
+    int16_t dateLine = FONT_XXLARGE_BOLD->yAdvance;
+    int16_t sunLine = sunTimes ? std::max<int16_t>(FONT_LARGE->yAdvance, FONT_SIZE_LARGE) : 0;
+    int16_t blockWidth = std::max({textWidth(FONT_XXLARGE_BOLD, weekday), textWidth(FONT_XXLARGE_BOLD, date),
+                                   (int16_t)(sunriseWidth + SPACING_XLARGE + sunsetWidth)});
+    int16_t blockHeight = 2 * dateLine + sunLine;
+    int16_t headerHeight = std::max<int16_t>(weather->height, blockHeight);
+
+    int16_t x = PADDING_X + (CONTENT_WIDTH - weather->advance - SPACING_XLARGE - blockWidth) / 2;
+    addIcon(weather, x, y + (headerHeight - weather->height) / 2);
+    x += weather->advance + SPACING_XLARGE;
+    int16_t blockTop = y + (headerHeight - blockHeight) / 2;
+    addText(FONT_XXLARGE_BOLD, weekday, x, blockTop, dateLine);
+    addText(FONT_XXLARGE_BOLD, date, x, blockTop + dateLine, dateLine);
+    if (sunTimes) {
+        // justify-content: space-evenly
+        int16_t space = (blockWidth - sunriseWidth - SPACING_XLARGE - sunsetWidth) / 3;
+        placeRun(sunrise, 2, SPACING_SMALL, x + space, blockTop + 2 * dateLine, sunLine);
+        placeRun(sunset, 2, SPACING_SMALL, x + 2 * space + sunriseWidth + SPACING_XLARGE,
+                 blockTop + 2 * dateLine, sunLine);
+    }
+    y += headerHeight + SPACING_XLARGE;
+
+    for (uint8_t i = 0; i < data.roomCount; i++) {
+        const DashboardData::Room& room = data.rooms[i];
+        const GlyphCache::Glyph* thermometer = icon("temperature-three-quarters", FONT_SIZE_HUGE / 2);
+        const GlyphCache::Glyph* droplet = icon("droplet", FONT_SIZE_HUGE / 2);
+        const GlyphCache::Glyph* water = icon("water", FONT_SIZE_MEDIUM);
+        const GlyphCache::Glyph* down = icon("arrow-down", FONT_SIZE_MEDIUM);
+        const GlyphCache::Glyph* up = icon("arrow-up", FONT_SIZE_MEDIUM);
+        const GlyphCache::Glyph* battery = room.battery >= 0 ? icon(batteryIcon(room.battery), FONT_SIZE_MEDIUM)
+                                                             : nullptr;
+        if (missingIcon_[0] != '\0') {
+            return false;
+        }
+
+        y += ROOM_PADDING;
+        addText(FONT_XXLARGE_BOLD, room.title,
+                PADDING_X + (CONTENT_WIDTH - textWidth(FONT_XXLARGE_BOLD, room.title)) / 2, y, dateLine);
+        y += dateLine + ROOM_TITLE_MARGIN;
+
+        // Temperature on the left, humidity on the right
+        char temperature[16];
+        char humidity[16];
+        formatTenths(temperature, sizeof(temperature), room.temperature, "\xB0" "C");
+        formatTenths(humidity, sizeof(humidity), room.humidity, "%");
+        Piece left[] = {{thermometer, nullptr, nullptr}, {nullptr, FONT_HUGE_BOLD, temperature}};
+        Piece right[] = {{droplet, nullptr, nullptr}, {nullptr, FONT_HUGE_BOLD, humidity}};
+        int16_t line = std::max<int16_t>(FONT_HUGE_BOLD->yAdvance, thermometer->height);
+        placeRun(left, 2, SPACING_MEDIUM, PADDING_X, y, line);
+        placeRun(right, 2, SPACING_MEDIUM, PADDING_X + CONTENT_WIDTH - runWidth(right, 2, SPACING_MEDIUM), y, line);
+        y += line;
+
+        // Dew point, range and battery, justify-content: space-between
+        char dewPoint[16];
+        char min[16];
+        char max[16];
+        formatTenths(dewPoint, sizeof(dewPoint), room.dewPoint, "\xB0" "C");
+        formatTenths(min, sizeof(min), room.min, "\xB0" "C");
+        formatTenths(max, sizeof(max), room.max, "\xB0" "C");
+        Piece dew[] = {{water, nullptr, nullptr}, {nullptr, FONT_MEDIUM_BOLD, dewPoint}};
+        Piece range[] = {{down, nullptr, nullptr}, {nullptr, FONT_MEDIUM_BOLD, min},
+                         {up, nullptr, nullptr}, {nullptr, FONT_MEDIUM_BOLD, max}};
+        Piece level[] = {{battery, nullptr, nullptr}};
+        int16_t dewWidth = runWidth(dew, 2, SPACING_SMALL);
+        int16_t rangeWidth = runWidth(range, 4, SPACING_SMALL);
+        int16_t levelWidth = battery ? battery->advance : 0;
+        int16_t gaps = battery ? 2 : 1;
+        int16_t space = (CONTENT_WIDTH - dewWidth - rangeWidth - levelWidth) / gaps;
+        line = std::max<int16_t>(FONT_MEDIUM_BOLD->yAdvance, FONT_SIZE_MEDIUM);
+        placeRun(dew, 2, SPACING_SMALL, PADDING_X, y, line);
+        placeRun(range, 4, SPACING_SMALL, PADDING_X + dewWidth + space, y, line);
+        if (battery) {
+            placeRun(level, 1, 0, PADDING_X + CONTENT_WIDTH - levelWidth, y, line);
+        }
+        y += line + ROOM_PADDING;
+
+        if (i + 1 < data.roomCount) {
+            addRule(PADDING_X, y, CONTENT_WIDTH, ROOM_BORDER);
+            y += ROOM_BORDER;
+        }
+    }
+    return !overflow_;
+}
+
+const GlyphCache::Glyph* DashboardRenderer::icon(const char* name, uint16_t size) {
+    const GlyphCache::Glyph* glyph = glyphs_.find(name, size);
+    if (glyph == nullptr && missingIcon_[0] == '\0') {
+        snprintf(missingIcon_, sizeof(missingIcon_), "%s", name);
+        missingIconSize_ = size;
+    }
+    return glyph;
+}
+
+DashboardRenderer::Item* DashboardRenderer::addItem(Item::Kind kind, int16_t x, int16_t top, int16_t bottom) {
+    if (itemCount_ == MAX_ITEMS) {
+        // Dropping the element would render an incomplete dashboard without notice
+        overflow_ = true;
+        return nullptr;
+    }
+    Item& item = items_[itemCount_++];
+    item.kind = kind;
+    item.x = x;
+    item.top = top;
+    item.bottom = bottom;
+    return &item;
+}
+
+void DashboardRenderer::addText(const GFXfont* font, const char* text, int16_t x, int16_t top, int16_t height) {
+    int16_t baseline = top + (height + capHeight(font)) / 2;
+    // Descenders and umlaut dots stay within one line height
+    Item* item = addItem(Item::TEXT, x, baseline - font->yAdvance, baseline + font->yAdvance / 2);
+    if (item != nullptr) {
+        item->font = font;
+        item->baseline = baseline;
+        snprintf(item->text, sizeof(item->text), "%s", text);
+    }
+}
+
+void DashboardRenderer::addIcon(const GlyphCache::Glyph* glyph, int16_t x, int16_t top) {
+    Item* item = addItem(Item::ICON, x, top, top + glyph->height);
+    if (item != nullptr) {
+        item->glyph = glyph;
+    }
+}
+
+void DashboardRenderer::addRule(int16_t x, int16_t top, int16_t width, int16_t height) {
+    Item* item = addItem(Item::RULE, x, top, top + height);
+    if (item != nullptr) {
+        item->width = width;
+    }
+}
+
+int16_t DashboardRenderer::pieceWidth(const Piece& piece) {
+    return piece.glyph ? piece.glyph->advance : textWidth(piece.font, piece.text);
+}
+
+int16_t DashboardRenderer::runWidth(const Piece* pieces, size_t count, int16_t gap) {
+    int16_t width = 0;
+    for (size_t i = 0; i < count; i++) {
+        width += pieceWidth(pieces[i]) + (i > 0 ? gap : 0);
+    }
+    return width;
+}
+
+void DashboardRenderer::placeRun(const Piece* pieces, size_t count, int16_t gap, int16_t x, int16_t top,
+                                 int16_t height) {
+    for (size_t i = 0; i < count; i++) {
+        const Piece& piece = pieces[i];
+        if (piece.glyph) {
+            addIcon(piece.glyph, x, top + (height - piece.glyph->height) / 2);
+        } else {
+            addText(piece.font, piece.text, x, top, height);
+        }
+        x += pieceWidth(piece) + gap;
+    }
+}
+
+int16_t DashboardRenderer::textWidth(const GFXfont* font, const char* text) {
+    int16_t width = 0;
+    for (const char* p = text; *p != '\0'; p++) {
+        uint8_t c = *p;
+        if (c == DEGREE_SIGN) {
+            width += degreeSize(font) * 3 / 2;
+            continue;
+        }
+        bool umlaut;
+        const GFXglyph* glyph = findGlyph(font, baseCharacter(c, umlaut));
+        if (glyph != nullptr) {
+            width += glyph->xAdvance;
+        }
+    }
+    return width;
+}
+
+int16_t DashboardRenderer::capHeight(const GFXfont* font) {
+    const GFXglyph* glyph = findGlyph(font, 'H');
+    return glyph ? -glyph->yOffset : font->yAdvance / 2;
+}
+
+int16_t DashboardRenderer::degreeSize(const GFXfont* font) {
+    return std::max(4, capHeight(font) * 2 / 5);
+}
+
+void DashboardRenderer::render(FrameWriter& writer) {
+    writer.begin();
+    for (bandTop_ = 0; bandTop_ < FrameWriter::HEIGHT; bandTop_ += BAND_ROWS) {
+        memset(band_, 0, sizeof(band_));
+        for (size_t i = 0; i < itemCount_; i++) {
+            const Item& item = items_[i];
+            if (item.bottom <= bandTop_ || item.top >= bandTop_ + BAND_ROWS) {
+                continue;
+            }
+            switch (item.kind) {
+            case Item::TEXT:
+                drawText(item);
+                break;
+            case Item::ICON:
+                drawIcon(item);
+                break;
+            case Item::RULE:
+                fillRect(item.x, item.top, item.width, item.bottom - item.top);
+                break;
+            }
+        }
+        writer.write(band_, sizeof(band_));
+    }
+}
+
+void DashboardRenderer::setPixel(int16_t x, int16_t y) {
+    y -= bandTop_;
+    if (x < 0 || x >= FrameWriter::WIDTH || y < 0 || y >= BAND_ROWS) {
+        return;
+    }
+    band_[y * FrameWriter::ROW_BYTES + x / 8] |= 0x80 >> (x % 8);
+}
+
+void DashboardRenderer::orByte(uint8_t* row, int16_t column, uint8_t bits) {
+    if (column >= 0 && column < (int16_t)FrameWriter::ROW_BYTES) {
+        row[column] |= bits;
+    }
+}
+
+void DashboardRenderer::drawText(const Item& item) {
+    const GFXfont* font = item.font;
+    int16_t x = item.x;
+    for (const char* p = item.text; *p != '\0'; p++) {
+        uint8_t c = *p;
+        if (c == DEGREE_SIGN) {
+            // Ring at the height of capital letters
+            int16_t size = degreeSize(font);
+            int16_t thickness = std::max(1, size / 5);
+            int16_t radius2 = size * size / 4;
+            int16_t inner2 = (size / 2 - thickness) * (size / 2 - thickness);
+            int16_t top = item.baseline - capHeight(font);
+            for (int16_t dy = 0; dy < size; dy++) {
+                for (int16_t dx = 0; dx < size; dx++) {
+                    int16_t rx = 2 * dx - size + 1;
+                    int16_t ry = 2 * dy - size + 1;
+                    int16_t d2 = (rx * rx + ry * ry) / 4;
+                    if (d2 < radius2 && d2 >= inner2) {
+                        setPixel(x + size / 4 + dx, top + dy);
+                    }
+                }
+            }
+            x += size * 3 / 2;
+            continue;
+        }
+
+        bool umlaut;
+        const GFXglyph* glyph = findGlyph(font, baseCharacter(c, umlaut));
+        if (glyph == nullptr) {
+            continue;
+        }
+        drawGlyph(font, *glyph, x, item.baseline);
+        if (umlaut) {
+            int16_t dot = std::max(2, capHeight(font) / 7);
+            int16_t top = item.baseline + glyph->yOffset - dot - std::max(1, dot / 2);
+            int16_t center = x + glyph->xOffset + glyph->width / 2;
+            fillRect(center - dot - dot / 2, top, dot, dot);
+            fillRect(center + dot / 2, top, dot, dot);
+        }
+        x += glyph->xAdvance;
+    }
+}
+
+void DashboardRenderer::drawGlyph(const GFXfont* font, const GFXglyph& glyph, int16_t x, int16_t baseline) {
+    // The glyph bitmap is a continuous bit stream without row padding
+    const uint8_t* bitmap = font->bitmap + glyph.bitmapOffset;
+    int16_t top = baseline + glyph.yOffset;
+    uint32_t bit = 0;
+    for (int16_t row = 0; row < glyph.height; row++, bit += glyph.width) {
+        int16_t y = top + row;
+        if (y < bandTop_) {
+            continue;
+        }
+        if (y >= bandTop_ + BAND_ROWS) {
+            break;
+        }
+        for (uint16_t col = 0; col < glyph.width; col++) {
+            uint32_t b = bit + col;
+            if (bitmap[b / 8] & (0x80 >> (b % 8))) {
+                setPixel(x + glyph.xOffset + col, y);
+            }
+        }
+    }
+}
+
+void DashboardRenderer::drawIcon(const Item& item) {
+    const GlyphCache::Glyph* glyph = item.glyph;
+    size_t rowBytes = glyph->width / 8;
+    int16_t first = std::max(item.top, bandTop_);
+    int16_t last = std::min<int16_t>(item.bottom, bandTop_ + BAND_ROWS);
+    // Shift the bytes of the icon to the pixel position
+    int16_t column = item.x >> 3;
+    uint8_t shift = item.x & 7;
+    for (int16_t y = first; y < last; y++) {
+        const uint8_t* src = glyph->bitmap + (y - item.top) * rowBytes;
+        uint8_t* dst = band_ + (y - bandTop_) * FrameWriter::ROW_BYTES;
+        for (size_t i = 0; i < rowBytes; i++) {
+            orByte(dst, column + i, src[i] >> shift);
+            if (shift != 0) {
+                orByte(dst, column + i + 1, src[i] << (8 - shift));
+            }
+        }
+    }
+}
+
+void DashboardRenderer::fillRect(int16_t x, int16_t y, int16_t w, int16_t h) {
+    for (int16_t row = y; row < y + h; row++) {
+        for (int16_t col = x; col < x + w; col++) {
+            setPixel(col, row);
+        }
+    }
+}
+
+} // namespace WeatherDisplay
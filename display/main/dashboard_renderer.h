@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <gfxfont.h>
+
+#include "dashboard_data.h"
+#include "frame_writer.h"
+#include "glyph_cache.h"
+
+namespace WeatherDisplay {
+
+// Renders the dashboard on the display from the values provided by the server, instead of
+// downloading the bitmap rendered by the server.
+//
+// The layout mirrors generateHtml() in dashboardTemplate.ts, using the Adafruit GFX fonts
+// closest to the CSS font sizes and the icons from the GlyphCache. layout() positions all
+// elements once. render() then draws the frame in bands of a few rows and streams them
+// through the FrameWriter, thus only the changed strips reach the controller RAM.
+class DashboardRenderer {
+public:
+    explicit DashboardRenderer(GlyphCache& glyphs) : glyphs_(glyphs) {}
+
+    // Position the elements of the dashboard for the given local time. Returns false if an
+    // icon is not in the glyph cache yet, see missingIcon(), or the dashboard has more
+    // elements than fit into the item list, see overflow().
+    bool layout(const DashboardData& data, const struct tm& time);
+    const char* missingIcon() const { return missingIcon_; }
+    uint16_t missingIconSize() const { return missingIconSize_; }
+    bool overflow() const { return overflow_; }
+
+    // Draw the laid out dashboard as a full frame
+    void render(FrameWriter& writer);
+
+private:
+    static constexpr size_t MAX_ITEMS = 96;
+    static constexpr uint16_t BAND_ROWS = 40;
+    static_assert(FrameWriter::HEIGHT % BAND_ROWS == 0, "frame must consist of complete bands");
+
+    struct Item {
+        enum Kind : uint8_t { TEXT, ICON, RULE } kind;
+        int16_t x;
+        // Rows covered by the item, used to skip it in other bands
+        int16_t top;
+        int16_t bottom;
+        // TEXT: font, text and baseline
+        const GFXfont* font;
+        int16_t baseline;
+        char text[28];
+        // ICON: bitmap, RULE: width
+        const GlyphCache::Glyph* glyph;
+        int16_t width;
+    };
+
+    // Part of a horizontal run of icons and text, see placeRun()
+    struct Piece {
+        const GlyphCache::Glyph* glyph;
+        const GFXfont* font;
+        const char* text;
+    };
+
+    const GlyphCache::Glyph* icon(const char* name, uint16_t size);
+    Item* addItem(Item::Kind kind, int16_t x, int16_t top, int16_t bottom);
+    // Add text vertically centered within the line [top, top + height)
+    void addText(const GFXfont* font, const char* text, int16_t x, int16_t top, int16_t height);
+    void addIcon(const GlyphCache::Glyph* glyph, int16_t x, int16_t top);
+    void addRule(int16_t x, int16_t top, int16_t width, int16_t height);
+    static int16_t pieceWidth(const Piece& piece);
+    static int16_t runWidth(const Piece* pieces, size_t count, int16_t gap);
+    // Place the pieces from left to right, each vertically centered within the line
+    void placeRun(const Piece* pieces, size_t count, int16_t gap, int16_t x, int16_t top, int16_t height);
+
+    static int16_t textWidth(const GFXfont* font, const char* text);
+    static int16_t capHeight(const GFXfont* font);
+    static int16_t degreeSize(const GFXfont* font);
+
+    void setPixel(int16_t x, int16_t y);
+    void orByte(uint8_t* row, int16_t column, uint8_t bits);
+    void drawText(const Item& item);
+    void drawGlyph(const GFXfont* font, const GFXglyph& glyph, int16_t x, int16_t baseline);
+    void drawIcon(const Item& item);
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h);
+
+    GlyphCache& glyphs_;
+    char missingIcon_[32] = "";
+    uint16_t missingIconSize_ = 0;
+    bool overflow_ = false;
+
+    Item items_[MAX_ITEMS];
+    size_t itemCount_ = 0;
+
+    // Rows [bandTop_, bandTop_ + BAND_ROWS) in PBM format
+    int16_t bandTop_ = 0;
+    uint8_t band_[BAND_ROWS * FrameWriter::ROW_BYTES];
+};
+
+} // namespace WeatherDisplay
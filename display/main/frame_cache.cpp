@@ -0,0 +1,100 @@
+#include "frame_cache.h"
+#include <cstring>
+#include <esp_log.h>
+
+namespace WeatherDisplay {
+
+static const char* TAG = "frame_cache";
+
+bool FrameCache::begin() {
+    partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, PARTITION_SUBTYPE, PARTITION_LABEL);
+    if (partition_ == nullptr) {
+        ESP_LOGW(TAG, "No frame cache partition");
+        return false;
+    }
+    // Slots must start at an erase sector
+    slotSize_ = partition_->size / SLOTS / partition_->erase_size * partition_->erase_size;
+    if (slotSize_ < DATA_OFFSET + FrameWriter::FRAME_BYTES) {
+        ESP_LOGW(TAG, "Frame cache partition too small");
+        partition_ = nullptr;
+        return false;
+    }
+
+    slot_ = -1;
+    for (size_t i = 0; i < SLOTS; i++) {
+        Header header;
+        if (esp_partition_read(partition_, i * slotSize_, &header, sizeof(header)) != ESP_OK ||
+            header.magic != MAGIC) {
+            continue;
+        }
+        if (slot_ < 0 || header.sequence > header_.sequence) {
+            slot_ = i;
+            header_ = header;
+        }
+    }
+    header_.etag[sizeof(header_.etag) - 1] = '\0';
+    return valid();
+}
+
+bool FrameCache::restore(FrameWriter& writer) {
+    if (!valid()) {
+        return false;
+    }
+
+    size_t offset = slot_ * slotSize_ + DATA_OFFSET;
+    uint8_t chunk[FrameWriter::ROW_BYTES * FrameWriter::STRIP_ROWS];
+    writer.begin();
+    while (!writer.complete()) {
+        if (esp_partition_read(partition_, offset, chunk, sizeof(chunk)) != ESP_OK) {
+            return false;
+        }
+        writer.write(chunk, sizeof(chunk));
+        offset += sizeof(chunk);
+    }
+
+    if (writer.hash() != header_.hash) {
+        ESP_LOGW(TAG, "Cached frame is corrupted");
+        slot_ = -1;
+        return false;
+    }
+    return true;
+}
+
+bool FrameCache::store(const uint8_t* frame, uint32_t hash, const char* etag, time_t time) {
+    if (partition_ == nullptr) {
+        return false;
+    }
+
+    int slot = valid() ? (slot_ + 1) % SLOTS : 0;
+    Header header = {};
+    header.magic = MAGIC;
+    header.sequence = valid() ? header_.sequence + 1 : 0;
+    header.hash = hash;
+    header.time = time;
+    strlcpy(header.etag, etag, sizeof(header.etag));
+
+    // Only erase the sectors the frame occupies, the remainder of the slot stays unused
+    size_t offset = slot * slotSize_;
+    size_t eraseSize = (DATA_OFFSET + FrameWriter::FRAME_BYTES + partition_->erase_size - 1) /
+                       partition_->erase_size * partition_->erase_size;
+    esp_err_t err = esp_partition_erase_range(partition_, offset, eraseSize);
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition_, offset + DATA_OFFSET, frame, FrameWriter::FRAME_BYTES);
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition_, offset, &header, sizeof(header));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store frame: %s", esp_err_to_name(err));
+        // The erased slot may have been the only valid one
+        begin();
+        return false;
+    }
+
+    slot_ = slot;
+    header_ = header;
+    ESP_LOGI(TAG, "Stored frame %08lx in slot %d", (unsigned long)hash, slot);
+    return true;
+}
+
+} // namespace WeatherDisplay
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <esp_partition.h>
+#include "frame_writer.h"
+
+namespace WeatherDisplay {
+
+// Keeps the last dashboard in a flash partition, such that it can be shown right after
+// booting and while the server is unreachable.
+//
+// The partition holds two slots that are written alternately. Each slot consists of a
+// header followed by the PBM pixel data. The header is written last, thus an interrupted
+// write leaves the previous slot intact.
+class FrameCache {
+public:
+    static constexpr const char* PARTITION_LABEL = "frame";
+    static constexpr esp_partition_subtype_t PARTITION_SUBTYPE = static_cast<esp_partition_subtype_t>(0x40);
+
+    // Find the partition and the newest valid slot
+    bool begin();
+
+    bool valid() const { return slot_ >= 0; }
+    // Hash, ETag and target time of the cached frame, only meaningful if valid()
+    uint32_t hash() const { return header_.hash; }
+    const char* etag() const { return header_.etag; }
+    time_t time() const { return header_.time; }
+
+    // Stream the cached frame through the writer. Returns false if the data doesn't match
+    // the stored hash, in which case the writer contains the corrupted frame.
+    bool restore(FrameWriter& writer);
+    // Replace the older slot by the given frame in PBM orientation
+    bool store(const uint8_t* frame, uint32_t hash, const char* etag, time_t time);
+
+private:
+    static constexpr uint32_t MAGIC = 0x57444643;
+    static constexpr size_t SLOTS = 2;
+    // The pixel data starts at a flash write boundary
+    static constexpr size_t DATA_OFFSET = 256;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t hash;
+        int64_t time;
+        char etag[48];
+    };
+    static_assert(sizeof(Header) <= DATA_OFFSET, "header must fit before the pixel data");
+
+    const esp_partition_t* partition_ = nullptr;
+    size_t slotSize_ = 0;
+    int slot_ = -1;
+    Header header_ = {};
+};
+
+} // namespace WeatherDisplay
@@ -0,0 +1,258 @@
+#include "frame_writer.h"
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <phase_trace.h>
+
+namespace WeatherDisplay {
+
+static inline uint32_t loadWord(const uint8_t* data) {
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+static inline uint16_t countBits(const uint8_t* data, size_t len, const uint8_t* old = nullptr) {
+    uint16_t count = 0;
+    for (size_t i = 0; i < len; i++) {
+        count += __builtin_popcount(old ? data[i] ^ old[i] : data[i]);
+    }
+    return count;
+}
+
+// Transpose an 8x8 bit matrix, with rows stride bytes apart and the most significant bit
+// as first column. Afterwards, out[k] contains column k. See Hacker's Delight, 7-3.
+static inline void transpose8(const uint8_t* in, size_t stride, uint8_t out[8]) {
+    uint32_t x = (uint32_t(in[0]) << 24) | (in[stride] << 16) | (in[2 * stride] << 8) | in[3 * stride];
+    uint32_t y = (uint32_t(in[4 * stride]) << 24) | (in[5 * stride] << 16) | (in[6 * stride] << 8) | in[7 * stride];
+    uint32_t t;
+
+    // Swap 1x1, 2x2 and finally 4x4 blocks
+    t = (x ^ (x >> 7)) & 0x00AA00AA;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;
+    y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC;
+    y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    out[0] = x >> 24;
+    out[1] = x >> 16;
+    out[2] = x >> 8;
+    out[3] = x;
+    out[4] = y >> 24;
+    out[5] = y >> 16;
+    out[6] = y >> 8;
+    out[7] = y;
+}
+
+void FrameWriter::begin(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    // Changes of an interrupted transfer are already part of the frame copy
+    flushWindow();
+
+    x_ = x;
+    y_ = y;
+    w_ = w;
+    rowBytes_ = w / 8;
+    regionBytes_ = rowBytes_ * h;
+    stripFill_ = 0;
+    bytesWritten_ = 0;
+    stripIndex_ = 0;
+    hash_ = HASH_OFFSET;
+    changedStrips_ = 0;
+}
+
+void FrameWriter::invalidate() {
+    stripKnown_.reset();
+    windowStrips_ = 0;
+}
+
+void FrameWriter::resetFlippedPixels() {
+    std::fill(std::begin(flippedPixels_), std::end(flippedPixels_), 0);
+}
+
+uint32_t FrameWriter::hashWords(const uint8_t* data, size_t len) {
+    uint32_t hash = HASH_OFFSET;
+    for (size_t i = 0; i < len; i += 4) {
+        hash = (hash ^ loadWord(data + i)) * HASH_PRIME;
+    }
+    return hash;
+}
+
+uint32_t FrameWriter::frameHash() const {
+    uint32_t hash = HASH_OFFSET;
+    for (size_t strip = 0; strip < STRIPS; strip++) {
+        hash = (hash ^ hashWords(frame_ + strip * STRIP_BYTES, STRIP_BYTES)) * HASH_PRIME;
+    }
+    return hash;
+}
+
+void FrameWriter::write(const uint8_t* data, size_t len) {
+    if (len > remaining()) {
+        len = remaining();
+    }
+
+    size_t stripBytes = STRIP_ROWS * rowBytes_;
+    while (len > 0) {
+        size_t n = stripBytes - stripFill_;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(strip_ + stripFill_, data, n);
+        stripFill_ += n;
+        bytesWritten_ += n;
+        data += n;
+        len -= n;
+
+        if (stripFill_ == stripBytes) {
+            flushStrip();
+        }
+    }
+
+    if (complete()) {
+        flushWindow();
+    }
+}
+
+void FrameWriter::flushStrip() {
+    uint16_t strip = y_ / STRIP_ROWS + stripIndex_;
+    uint8_t* old = frame_ + strip * STRIP_BYTES;
+    stripIndex_++;
+    stripFill_ = 0;
+
+    uint16_t x0 = x_ / 8;
+    uint16_t x1 = x0 + rowBytes_;
+    if (w_ == WIDTH) {
+        {
+            PHASE_TRACE_SCOPE(HASH);
+            hash_ = (hash_ ^ hashWords(strip_, STRIP_BYTES)) * HASH_PRIME;
+        }
+        if (stripKnown_[strip]) {
+            uint16_t flipped = diffStrip(old, x0, x1);
+            if (flipped == 0) {
+                return;
+            }
+            flippedPixels_[strip] += flipped;
+            if (x1 - x0 > FULL_STRIP_THRESHOLD) {
+                x0 = 0;
+                x1 = ROW_BYTES;
+            }
+        } else {
+            flippedPixels_[strip] += countBits(strip_, STRIP_BYTES);
+        }
+        memcpy(old, strip_, STRIP_BYTES);
+        stripKnown_[strip] = true;
+    } else {
+        // Partial strip, the frame copy remains complete if it was before
+        for (size_t i = 0; i < STRIP_ROWS; i++) {
+            uint8_t* dst = old + i * ROW_BYTES + x0;
+            const uint8_t* src = strip_ + i * rowBytes_;
+            flippedPixels_[strip] += countBits(src, rowBytes_, stripKnown_[strip] ? dst : nullptr);
+            memcpy(dst, src, rowBytes_);
+        }
+    }
+
+    changedStrips_++;
+    modified_ = true;
+    markDirty(strip, x0, x1);
+}
+
+uint16_t FrameWriter::diffStrip(const uint8_t* old, uint16_t& x0, uint16_t& x1) const {
+    constexpr size_t ROW_WORDS = ROW_BYTES / 4;
+
+    // Collect the changed bits of all rows per word column
+    uint32_t diff[ROW_WORDS] = {};
+    uint16_t flipped = 0;
+    for (size_t i = 0; i < STRIP_ROWS; i++) {
+        const uint8_t* a = strip_ + i * ROW_BYTES;
+        const uint8_t* b = old + i * ROW_BYTES;
+        for (size_t j = 0; j < ROW_WORDS; j++) {
+            uint32_t d = loadWord(a + 4 * j) ^ loadWord(b + 4 * j);
+            // Most words are unchanged, skip counting their bits
+            if (d != 0) {
+                diff[j] |= d;
+                flipped += __builtin_popcount(d);
+            }
+        }
+    }
+
+    size_t first = 0;
+    while (first < ROW_WORDS && diff[first] == 0) {
+        first++;
+    }
+    if (first == ROW_WORDS) {
+        x0 = x1 = 0;
+        return 0;
+    }
+    size_t last = ROW_WORDS - 1;
+    while (diff[last] == 0) {
+        last--;
+    }
+
+    // Words are little endian, thus the lowest byte is the leftmost one
+    x0 = first * 4 + __builtin_ctz(diff[first]) / 8;
+    x1 = last * 4 + 4 - __builtin_clz(diff[last]) / 8;
+    return flipped;
+}
+
+void FrameWriter::markDirty(uint16_t strip, uint16_t x0, uint16_t x1) {
+    // Each byte column covers 8 controller rows, with one byte per strip
+    size_t dirtyBytes = (x1 - x0) * 8;
+
+    if (windowStrips_ > 0) {
+        uint16_t mergedX0 = std::min(windowX0_, x0);
+        uint16_t mergedX1 = std::max(windowX1_, x1);
+        size_t mergedBytes = (windowStrips_ + 1) * (mergedX1 - mergedX0) * 8;
+        if (strip == windowStrip_ + windowStrips_ && windowStrips_ < MAX_WINDOW_STRIPS &&
+            mergedBytes <= windowDirtyBytes_ + dirtyBytes + MERGE_SLACK) {
+            windowStrips_++;
+            windowX0_ = mergedX0;
+            windowX1_ = mergedX1;
+            windowDirtyBytes_ += dirtyBytes;
+            return;
+        }
+        flushWindow();
+    }
+
+    windowStrip_ = strip;
+    windowStrips_ = 1;
+    windowX0_ = x0;
+    windowX1_ = x1;
+    windowDirtyBytes_ = dirtyBytes;
+}
+
+void FrameWriter::flushWindow() {
+    if (windowStrips_ == 0) {
+        return;
+    }
+
+    // With rotation 3, PBM pixel (x, y) ends up at controller pixel (y, WIDTH - 1 - x).
+    // Thus, each 8x8 pixel block of a strip is transposed and its columns are reversed.
+    uint16_t rows = (windowX1_ - windowX0_) * 8;
+    {
+        PHASE_TRACE_SCOPE(BLIT);
+        for (uint16_t s = 0; s < windowStrips_; s++) {
+            const uint8_t* src = frame_ + (windowStrip_ + s) * STRIP_BYTES;
+            for (uint16_t x = windowX0_; x < windowX1_; x++) {
+                uint8_t block[8];
+                transpose8(src + x, ROW_BYTES, block);
+
+                // controller row of the first pixel in the block
+                uint16_t row = (windowX1_ - x) * 8 - 1;
+                for (uint16_t k = 0; k < 8; k++) {
+                    // PBM uses 1 for black, whereas the controller uses 1 for white
+                    window_[(row - k) * windowStrips_ + s] = ~block[k];
+                }
+            }
+        }
+    }
+
+    epd_.writeImage(window_, windowStrip_ * STRIP_ROWS, WIDTH - windowX1_ * 8, windowStrips_ * STRIP_ROWS, rows);
+    windowStrips_ = 0;
+}
+
+} // namespace WeatherDisplay
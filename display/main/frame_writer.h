@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <bitset>
+#include <GxEPD2_426_GDEQ0426T82Mod.h>
+
+namespace WeatherDisplay {
+
+// Streams the pixel data of a PBM dashboard directly into the controller RAM.
+//
+// The server renders the dashboard in portrait orientation, whereas the panel is
+// mounted with rotation 3. Thus, eight consecutive PBM rows form one byte-wide column
+// of the controller RAM. The writer collects these rows into a strip and compares it
+// against its copy of the controller RAM. Only the changed columns are rotated and
+// written, changes in consecutive strips are merged into a single RAM window.
+class FrameWriter {
+public:
+    using Driver = GxEPD2_426_GDEQ0426T82Mod;
+
+    // Dimensions of the PBM image
+    static constexpr uint16_t WIDTH = Driver::HEIGHT;
+    static constexpr uint16_t HEIGHT = Driver::WIDTH;
+    static constexpr size_t ROW_BYTES = (WIDTH + 7) / 8;
+    static constexpr size_t FRAME_BYTES = ROW_BYTES * HEIGHT;
+    // One byte in controller RAM covers eight pixels
+    static constexpr size_t STRIP_ROWS = 8;
+    static constexpr size_t STRIPS = HEIGHT / STRIP_ROWS;
+
+    explicit FrameWriter(Driver& epd) : epd_(epd) {}
+
+    // Start receiving the pixel data for a region of the PBM image, by default the
+    // whole frame. The region must be aligned to multiples of 8 pixels.
+    void begin(uint16_t x = 0, uint16_t y = 0, uint16_t w = WIDTH, uint16_t h = HEIGHT);
+    // Consume the next chunk of PBM pixel data. Chunks can have an arbitrary size.
+    // Data beyond the end of the region is ignored.
+    void write(const uint8_t* data, size_t len);
+
+    // Forget the frame copy, needed after the controller RAM was written elsewhere
+    void invalidate();
+
+    size_t bytesWritten() const { return bytesWritten_; }
+    size_t remaining() const { return regionBytes_ - bytesWritten_; }
+    bool complete() const { return bytesWritten_ == regionBytes_; }
+    // Hash of the full frame received so far, combines the hashes of all strips
+    uint32_t hash() const { return hash_; }
+    // Number of strips that differ from the controller RAM
+    uint16_t changedStrips() const { return changedStrips_; }
+    // Whether any region changed the controller RAM since resetModified(). Unlike
+    // complete(), this covers all regions, e.g. the earlier patches of an interrupted delta.
+    bool modified() const { return modified_; }
+    void resetModified() { modified_ = false; }
+
+    static constexpr uint32_t HASH_OFFSET = 2166136261u;
+    static constexpr uint32_t HASH_PRIME = 16777619u;
+    // FNV-1a variant that processes 32 bit little endian words, len must be a multiple of 4
+    static uint32_t hashWords(const uint8_t* data, size_t len);
+
+    // Copy of the controller RAM in PBM orientation, only valid if frameComplete()
+    const uint8_t* frame() const { return frame_; }
+    bool frameComplete() const { return stripKnown_.all(); }
+    // Hash of the frame copy like hash(), for frames written in several regions
+    uint32_t frameHash() const;
+
+    // Number of pixels per strip that changed their color since resetFlippedPixels().
+    // Strips without frame copy are assumed to have been white before.
+    const uint16_t* flippedPixels() const { return flippedPixels_; }
+    void resetFlippedPixels();
+
+private:
+    static constexpr size_t STRIP_BYTES = STRIP_ROWS * ROW_BYTES;
+    static_assert(HEIGHT % STRIP_ROWS == 0, "frame must consist of complete strips");
+    static_assert(ROW_BYTES % 4 == 0, "rows must consist of complete words");
+
+    // Write the whole strip once more than this many byte columns changed
+    static constexpr uint16_t FULL_STRIP_THRESHOLD = ROW_BYTES * 3 / 4;
+    // Upper limit for the strips merged into one RAM window
+    static constexpr uint16_t MAX_WINDOW_STRIPS = 8;
+    // Merge changes if this adds at most this many unchanged bytes to the window
+    static constexpr size_t MERGE_SLACK = 64;
+
+    void flushStrip();
+    // Determine the byte columns [x0, x1) in which the received strip differs from the
+    // frame copy. Returns the number of differing pixels, and x0 == x1 if there are none.
+    uint16_t diffStrip(const uint8_t* old, uint16_t& x0, uint16_t& x1) const;
+    // Add byte columns [x0, x1) of a strip to the pending RAM window
+    void markDirty(uint16_t strip, uint16_t x0, uint16_t x1);
+    void flushWindow();
+
+    Driver& epd_;
+    uint16_t x_ = 0;
+    uint16_t y_ = 0;
+    uint16_t w_ = WIDTH;
+    size_t rowBytes_ = ROW_BYTES;
+    size_t regionBytes_ = FRAME_BYTES;
+
+    alignas(uint32_t) uint8_t strip_[STRIP_BYTES];
+    size_t stripFill_ = 0;
+    size_t bytesWritten_ = 0;
+    uint16_t stripIndex_ = 0;
+    uint32_t hash_ = HASH_OFFSET;
+    uint16_t changedStrips_ = 0;
+    bool modified_ = false;
+    uint16_t flippedPixels_[STRIPS] = {};
+
+    // Content of the controller RAM in PBM orientation
+    alignas(uint32_t) uint8_t frame_[FRAME_BYTES];
+    std::bitset<STRIPS> stripKnown_;
+
+    // Pending RAM window, covers strips [windowStrip_, windowStrip_ + windowStrips_)
+    // and PBM byte columns [windowX0_, windowX1_)
+    uint16_t windowStrip_ = 0;
+    uint16_t windowStrips_ = 0;
+    uint16_t windowX0_ = 0;
+    uint16_t windowX1_ = 0;
+    // number of changed bytes within the window
+    size_t windowDirtyBytes_ = 0;
+    // rotated window, one row per controller row
+    uint8_t window_[MAX_WINDOW_STRIPS * WIDTH];
+};
+
+} // namespace WeatherDisplay
@@ -0,0 +1,43 @@
+#include "ghosting_budget.h"
+#include <iterator>
+
+namespace WeatherDisplay {
+
+void GhostingBudget::addPartialRefresh(const uint16_t* flippedPixels) {
+    state_.partialRefreshes++;
+    for (size_t i = 0; i < REGIONS; i++) {
+        for (size_t j = 0; j < REGION_STRIPS; j++) {
+            state_.flippedPixels[i] += flippedPixels[i * REGION_STRIPS + j];
+        }
+    }
+}
+
+void GhostingBudget::addFullChange() {
+    state_.partialRefreshes++;
+    for (uint32_t& flipped : state_.flippedPixels) {
+        flipped += REGION_PIXELS;
+    }
+}
+
+void GhostingBudget::addFullRefresh() {
+    state_ = {};
+}
+
+bool GhostingBudget::fullRefreshDue(const struct tm& time) const {
+    return flipUsage() >= HARD_LIMIT_FACTOR * 100 || (exceeded() && isQuietTime(time));
+}
+
+bool GhostingBudget::isQuietTime(const struct tm& time) {
+    return time.tm_hour >= QUIET_HOUR_BEGIN && time.tm_hour < QUIET_HOUR_END;
+}
+
+uint32_t GhostingBudget::flipUsage() const {
+    uint32_t maxFlipped = *std::max_element(std::begin(state_.flippedPixels), std::end(state_.flippedPixels));
+    return static_cast<uint32_t>(maxFlipped * 100ULL / (MAX_REGION_FLIPS * REGION_PIXELS));
+}
+
+uint32_t GhostingBudget::refreshUsage() const {
+    return static_cast<uint32_t>(state_.partialRefreshes * 100ULL / MAX_PARTIAL_REFRESHES);
+}
+
+} // namespace WeatherDisplay
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include "frame_writer.h"
+
+namespace WeatherDisplay {
+
+// Decides when a full refresh is necessary to remove the ghosting of partial refreshes.
+//
+// Partial refreshes leave some ghosting behind, mostly where pixels changed their color.
+// The budget tracks the number of partial refreshes and the flipped pixels per horizontal
+// band of the dashboard since the last full refresh. Once a limit is exceeded, a full
+// refresh is due during the quiet hours at night. Only flips beyond twice the limit, i.e.
+// heavy changes in one region, make it due right away. The number of refreshes alone
+// never interrupts the day.
+//
+// All partial refreshes count, including the contrast redraws of an unchanged dashboard.
+// Status screens count as a change of every pixel, as they replace the whole dashboard.
+//
+// The datasheet of the panel gives no limits for partial refreshes, it only recommends
+// regular full refreshes. Thus, the limits are estimates to be tuned by observing the panel.
+class GhostingBudget {
+public:
+    // Bands of the PBM image, each covers the same number of strips
+    static constexpr size_t REGIONS = 10;
+    static constexpr size_t REGION_STRIPS = FrameWriter::STRIPS / REGIONS;
+    static constexpr uint32_t REGION_PIXELS = REGION_STRIPS * FrameWriter::STRIP_ROWS * FrameWriter::WIDTH;
+    static_assert(FrameWriter::STRIPS % REGIONS == 0, "regions must consist of complete strips");
+
+    // Roughly the refreshes of a day with a change every few minutes, thus the quiet
+    // hours do a full refresh about once per night
+    static constexpr uint32_t MAX_PARTIAL_REFRESHES = 240;
+    // Flipped pixels per region, as multiple of the region size. Sensor values change few
+    // pixels, thus this is mostly reached by replacing large parts, e.g. by status screens.
+    static constexpr uint32_t MAX_REGION_FLIPS = 4;
+    // Multiple of MAX_REGION_FLIPS that requires a full refresh outside of the quiet hours
+    static constexpr uint32_t HARD_LIMIT_FACTOR = 2;
+    // Local hours [QUIET_HOUR_BEGIN, QUIET_HOUR_END) in which nobody looks at the display
+    static constexpr int QUIET_HOUR_BEGIN = 1;
+    static constexpr int QUIET_HOUR_END = 5;
+
+    // Plain data to keep the budget in RTC memory during deep sleep
+    struct State {
+        uint32_t partialRefreshes;
+        uint32_t flippedPixels[REGIONS];
+    };
+
+    // Account for a partial refresh, flippedPixels contains the count per strip
+    void addPartialRefresh(const uint16_t* flippedPixels);
+    // Account for a partial refresh that replaced the whole dashboard, e.g. a status message
+    void addFullChange();
+    void addFullRefresh();
+
+    // Whether a limit is exceeded, thus a full refresh is due in the next quiet hours
+    bool exceeded() const { return usage() >= 100; }
+    // Whether the refresh at the given local time should be a full refresh
+    bool fullRefreshDue(const struct tm& time) const;
+    static bool isQuietTime(const struct tm& time);
+    // Used share of the limits in percent, based on the most used limit
+    uint32_t usage() const { return std::max(flipUsage(), refreshUsage()); }
+    // Used share of the flip limit of the most changed region and the refresh limit
+    uint32_t flipUsage() const;
+    uint32_t refreshUsage() const;
+
+    const State& state() const { return state_; }
+    void restore(const State& state) { state_ = state; }
+
+private:
+    State state_ = {};
+};
+
+} // namespace WeatherDisplay
@@ -0,0 +1,48 @@
+#include "glyph_cache.h"
+#include <cstring>
+
+namespace WeatherDisplay {
+
+const GlyphCache::Glyph* GlyphCache::find(const char* name, uint16_t size) const {
+    for (size_t i = 0; i < count_; i++) {
+        if (glyphs_[i].size == size && strcmp(glyphs_[i].name, name) == 0) {
+            return &glyphs_[i];
+        }
+    }
+    return nullptr;
+}
+
+uint8_t* GlyphCache::add(const char* name, uint16_t size, uint16_t width, uint16_t height, uint16_t advance) {
+    size_t bytes = width / 8 * height;
+    if (count_ == MAX_GLYPHS || arenaUsed_ + bytes > ARENA_BYTES || width % 8 != 0 ||
+        strlen(name) >= sizeof(Glyph::name)) {
+        return nullptr;
+    }
+
+    Glyph& glyph = glyphs_[count_];
+    strcpy(glyph.name, name);
+    glyph.size = size;
+    glyph.width = width;
+    glyph.height = height;
+    glyph.advance = advance <= width ? advance : width;
+    glyph.bitmap = arena_ + arenaUsed_;
+    pending_ = true;
+    return arena_ + arenaUsed_;
+}
+
+void GlyphCache::commit() {
+    if (!pending_) {
+        return;
+    }
+    Glyph& glyph = glyphs_[count_++];
+    arenaUsed_ += glyph.width / 8 * glyph.height;
+    pending_ = false;
+}
+
+void GlyphCache::clear() {
+    count_ = 0;
+    arenaUsed_ = 0;
+    pending_ = false;
+}
+
+} // namespace WeatherDisplay
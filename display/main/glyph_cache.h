@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace WeatherDisplay {
+
+// Bitmaps of icons rendered by the server, such that each icon and size is only downloaded
+// once. Icons are 1 bit per pixel PBM rows, padded to full bytes, with 1 for black.
+class GlyphCache {
+public:
+    struct Glyph {
+        char name[32];
+        uint16_t size;
+        // Bitmap dimensions, the width is a multiple of 8
+        uint16_t width;
+        uint16_t height;
+        // Horizontal space taken in the layout, at most width
+        uint16_t advance;
+        const uint8_t* bitmap;
+    };
+
+    const Glyph* find(const char* name, uint16_t size) const;
+    // Reserve space for a glyph and return its bitmap for filling, nullptr if the cache is
+    // full. The glyph is only found after commit().
+    uint8_t* add(const char* name, uint16_t size, uint16_t width, uint16_t height, uint16_t advance);
+    void commit();
+    // Drop all glyphs, invalidates pointers returned by find()
+    void clear();
+
+private:
+    static constexpr size_t MAX_GLYPHS = 16;
+    static constexpr size_t ARENA_BYTES = 6 * 1024;
+
+    Glyph glyphs_[MAX_GLYPHS];
+    size_t count_ = 0;
+    // Glyph reserved by add(), not yet committed
+    bool pending_ = false;
+    uint8_t arena_[ARENA_BYTES];
+    size_t arenaUsed_ = 0;
+};
+
+} // namespace WeatherDisplay
@@ -1,16 +1,69 @@
 #include "main.h"
+#include <algorithm>
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
 #include <nvs_flash.h>
 #include <HTTPClient.h>
 #include <SPI.h>
 #include <WiFi.h>
 #include <WiFiManager.h>
+#include <phase_trace.h>
 
 #include <Fonts/FreeMonoBold12pt7b.h>
 #include <Fonts/FreeMonoBold18pt7b.h>
 
 namespace WeatherDisplay {
 
+static const char* TAG = "display";
+
+// State that survives deep sleep
+struct RtcState {
+    uint32_t magic;
+    time_t lastTarget;
+    time_t nextUpdate;
+    uint32_t dashboardHash;
+    char dashboardEtag[48];
+    int downloadErrors;
+    uint32_t contrastRedraws;
+    uint32_t fetchMs;
+    uint32_t refreshMs[GxEPD2_426_GDEQ0426T82Mod::WAVEFORM_COUNT];
+    uint32_t wakeMs;
+    uint32_t cycles;
+    GhostingBudget::State ghosting;
+};
+constexpr uint32_t RTC_STATE_MAGIC = 0x57445332;
+RTC_DATA_ATTR static RtcState rtcState;
+// Also survives restarts, RecoveryLadder validates it
+RTC_NOINIT_ATTR static RecoveryLadder::State rtcRecoveryState;
+
+// Last successful WiFi connection, stored as blob in NVS
+struct WifiCache {
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+constexpr auto WIFI_CACHE_KEY = "wifi_cache";
+
+static bool loadWifiCache(WifiCache& cache) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return false;
+    }
+    size_t size = sizeof(cache);
+    esp_err_t ret = nvs_get_blob(nvs_handle, WIFI_CACHE_KEY, &cache, &size);
+    nvs_close(nvs_handle);
+    return ret == ESP_OK && size == sizeof(cache);
+}
+
 std::string getAPName() {
     uint8_t mac[6];
     WiFi.macAddress(mac);
@@ -19,6 +72,10 @@ std::string getAPName() {
     return std::string(AP_NAME_BASE) + "-" + std::string(macStr);
 }
 
+RecoveryLadder::State& WeatherDisplay::recoveryState() {
+    return rtcRecoveryState;
+}
+
 WeatherDisplay& WeatherDisplay::getInstance() {
     static WeatherDisplay instance;
     return instance;
@@ -45,12 +102,53 @@ Error WeatherDisplay::initialize() {
     ESP_ERROR_CHECK(esp_pm_configure(&cfg));
     ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "dashboard", &pm_lock_));
 
-    initEpaper();
+    // Track the connection timings
+    WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t info) {
+        if (event == ARDUINO_EVENT_WIFI_STA_CONNECTED) {
+            wifiAssociatedUs_ = esp_timer_get_time();
+        } else if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+            wifiGotIpUs_ = esp_timer_get_time();
+        }
+    });
+
+    // Keep the recovery statistics across restarts by the recovery ladder
+    esp_reset_reason_t reason = esp_reset_reason();
+    recovery_.begin(reason == ESP_RST_SW || reason == ESP_RST_DEEPSLEEP);
+
+    frameCache_.begin();
+    if (restoreState()) {
+        // Fast path after deep sleep: the display still shows the dashboard and the
+        // system time is retained, thus only WiFi is necessary
+        wokeFromSleep_ = true;
+        initEpaper();
+        if (initNvs() == Error::NONE && reconnectWifi()) {
+            loadWaveformLut();
+            initNtp();
+            wakeMs_ = (3 * wakeMs_ + esp_timer_get_time() / 1000) / 4;
+            config.timeout_ms = WDT_TIMEOUT_MS;
+            ESP_ERROR_CHECK(esp_task_wdt_reconfigure(&config));
+            return Error::NONE;
+        }
+        // Fall back to the regular startup
+        wokeFromSleep_ = false;
+        lastTarget_ = 0;
+    } else {
+        initEpaper();
+#if CONFIG_DISPLAY_SPI_BENCHMARK
+        benchmarkSpi();
+#endif
+        // Show the last dashboard until the first download succeeds
+        if (!showCachedFrame()) {
+            display_.clearScreen(GxEPD_WHITE);
+            display_.hibernate();
+        }
+    }
 
     Error err = initNvs();
     if (err != Error::NONE) {
         return err;
     }
+    loadWaveformLut();
 
     err = initWifiPassword();
     if (err != Error::NONE) {
@@ -65,23 +163,94 @@ Error WeatherDisplay::initialize() {
     initNtp();
 
     // Reconfigure watchdog with shorter timeout after WiFi is connected
-    config.timeout_ms = 30000;
+    config.timeout_ms = WDT_TIMEOUT_MS;
     ESP_ERROR_CHECK(esp_task_wdt_reconfigure(&config));
 
     return Error::NONE;
 }
 
+#if CONFIG_PHASE_TRACE_ENABLE
+// Records the phases reported by the display driver
+static void traceDisplayPhase(GxEPD2_426_GDEQ0426T82Mod::TracePhase phase, int64_t startUs, int64_t endUs) {
+    static constexpr PhaseTrace::Phase PHASES[] = {PhaseTrace::SPI_WRITE, PhaseTrace::WAIT_BUSY,
+                                                   PhaseTrace::HIBERNATE, PhaseTrace::REFRESH_START};
+    PhaseTrace::record(PHASES[phase], startUs, endUs);
+}
+#endif
+
 void WeatherDisplay::initEpaper() {
     SPI.begin(TFT_SCLK, TFT_MISO, TFT_MOSI, -1);
     display_.epd2.selectSPI(SPI, SPISettings(SPI_FREQUENCY, MSBFIRST, TFT_SPI_MODE));
-    display_.init(115200, true, 10, false);
+#if CONFIG_PHASE_TRACE_ENABLE
+    display_.epd2.setTraceCallback(traceDisplayPhase);
+#endif
+    display_.init(115200, false, 10, false);
 
     display_.setRotation(3);
-    display_.clearScreen(GxEPD_WHITE);
     display_.fillScreen(GxEPD_WHITE);
     display_.hibernate();
 }
 
+void WeatherDisplay::benchmarkSpi() {
+    auto& epd = display_.epd2;
+    // The initial write clears both RAM banks, keep it out of the measurements
+    epd.writeScreenBuffer();
+    for (bool bulk : {false, true}) {
+        epd.setBulkTransfer(bulk);
+        uint32_t ramWriteUs = epd.ramWriteMicros();
+        int64_t start = esp_timer_get_time();
+        // Only the amount of data matters, the frame copy has the size of the RAM
+        epd.writeImage(frameWriter_.frame(), 0, 0, GxEPD2_426_GDEQ0426T82Mod::WIDTH,
+                       GxEPD2_426_GDEQ0426T82Mod::HEIGHT);
+        ramWriteUs = epd.ramWriteMicros() - ramWriteUs;
+        ESP_LOGI(TAG, "SPI benchmark, %s: %u bytes in %lu us, %lu us with the window setup",
+                 bulk ? "bulk" : "per byte", (unsigned)FrameWriter::FRAME_BYTES, (unsigned long)ramWriteUs,
+                 (unsigned long)(esp_timer_get_time() - start));
+    }
+}
+
+bool WeatherDisplay::showCachedFrame() {
+    if (!restoreCachedFrame()) {
+        return false;
+    }
+    // The panel state is unknown after booting, thus use a full refresh
+    display_.epd2.refresh(false);
+    display_.hibernate();
+    contrastRedraws_ = 0;
+    ESP_LOGI(TAG, "Showing cached frame %08lx", (unsigned long)currentDashboardHash_);
+    return true;
+}
+
+bool WeatherDisplay::restoreCachedFrame() {
+    if (!frameCache_.valid()) {
+        return false;
+    }
+    if (!frameCache_.restore(frameWriter_)) {
+        return false;
+    }
+    frameWriter_.resetModified();
+    if (currentDashboardHash_ != frameCache_.hash()) {
+        // The panel shows another dashboard, redraw the RAM content even if the server
+        // reports no change
+        contrastRedraws_ = std::max<uint32_t>(contrastRedraws_, 1);
+    }
+    currentDashboardHash_ = frameCache_.hash();
+    strlcpy(dashboardEtag_, frameCache_.etag(), sizeof(dashboardEtag_));
+    return true;
+}
+
+void WeatherDisplay::cacheFrame(time_t target) {
+    // Only the complete frame copy can be cached. Otherwise, wait until it's complete.
+    if (!frameWriter_.frameComplete() || currentDashboardHash_ == 0 || dashboardEtag_[0] == '\0') {
+        return;
+    }
+    if (frameCache_.valid() &&
+        (frameCache_.hash() == currentDashboardHash_ || target - frameCache_.time() < FRAME_CACHE_INTERVAL)) {
+        return;
+    }
+    frameCache_.store(frameWriter_.frame(), currentDashboardHash_, dashboardEtag_, target);
+}
+
 Error WeatherDisplay::initNvs() {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -95,6 +264,27 @@ Error WeatherDisplay::initNvs() {
     return Error::NONE;
 }
 
+void WeatherDisplay::loadWaveformLut() {
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    size_t size = sizeof(waveformLut_);
+    esp_err_t ret = nvs_get_blob(nvs_handle, WAVEFORM_LUT_KEY, waveformLut_, &size);
+    nvs_close(nvs_handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return;
+    }
+    if (ret != ESP_OK || size != sizeof(waveformLut_)) {
+        // Keep the stock waveforms rather than driving the panel with a truncated LUT
+        ESP_LOGW(TAG, "Ignoring waveform LUT: %s, %u bytes", esp_err_to_name(ret), (unsigned)size);
+        return;
+    }
+    display_.epd2.setCustomLut(waveformLut_, size);
+    smallChangeWaveform_ = GxEPD2_426_GDEQ0426T82Mod::WAVEFORM_CUSTOM;
+    ESP_LOGI(TAG, "Using the waveform LUT from NVS for small changes");
+}
+
 Error WeatherDisplay::initWifiPassword() {
     // Generate a static AP password such that it doesn't change on each boot
 
@@ -149,8 +339,16 @@ Error WeatherDisplay::initWifiPassword() {
 }
 
 Error WeatherDisplay::initWifi() {
-    displayStatus("Connecting to WiFi");
+    if (connectCachedWifi()) {
+        return Error::NONE;
+    }
+
+    // Keep showing the cached dashboard while connecting
+    if (currentDashboardHash_ == 0) {
+        displayStatus("Connecting to WiFi");
+    }
     
+    wifiStartUs_ = esp_timer_get_time();
     WiFiManager wifiManager;
     wifiManager.setConnectRetries(3);
     wifiManager.setConfigPortalTimeout(300);
@@ -162,15 +360,111 @@ Error WeatherDisplay::initWifi() {
         displayStatus("WiFi setup failed");
         return Error::WIFI_CONNECT_FAILED;
     }
+    logWifiTimings("scan");
+    saveWifiCache();
 
     return Error::NONE;
 }
 
+bool WeatherDisplay::connectCachedWifi() {
+    WifiCache cache;
+    if (!loadWifiCache(cache)) {
+        return false;
+    }
+
+    // The credentials are stored by the WiFi driver
+    WiFi.mode(WIFI_STA);
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK || config.sta.ssid[0] == '\0') {
+        return false;
+    }
+
+    bool staticIp = WIFI_CACHE_STATIC_IP && cache.ip != 0;
+    if (staticIp) {
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    }
+
+    // Skip the scan by connecting directly to the last access point
+    wifiStartUs_ = esp_timer_get_time();
+    WiFi.begin(reinterpret_cast<const char*>(config.sta.ssid), reinterpret_cast<const char*>(config.sta.password),
+               cache.channel, cache.bssid);
+    int64_t deadline = wifiStartUs_ + WIFI_CACHED_TIMEOUT_MS * 1000LL;
+    while (WiFi.status() != WL_CONNECTED) {
+        if (esp_timer_get_time() > deadline) {
+            ESP_LOGW(TAG, "Connecting to the cached access point failed");
+            WiFi.disconnect();
+            if (staticIp) {
+                // Switch back to DHCP
+                WiFi.config(IPAddress(), IPAddress(), IPAddress());
+            }
+            return false;
+        }
+        delay(10);
+    }
+
+    logWifiTimings(staticIp ? "cached, static IP" : "cached");
+    saveWifiCache();
+    return true;
+}
+
+void WeatherDisplay::saveWifiCache() {
+    WifiCache cache = {};
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP();
+
+    // Only write on changes to limit the flash wear
+    WifiCache stored;
+    if (loadWifiCache(stored) && memcmp(&stored, &cache, sizeof(cache)) == 0) {
+        return;
+    }
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs_handle, WIFI_CACHE_KEY, &cache, sizeof(cache)) == ESP_OK) {
+        nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+}
+
+void WeatherDisplay::logWifiTimings(const char* method) {
+    PHASE_TRACE_RECORD(WIFI_CONNECT, wifiStartUs_, wifiGotIpUs_);
+    ESP_LOGI(TAG, "WiFi connected (%s): associated after %lld ms, got IP after %lld ms", method,
+             (long long)((wifiAssociatedUs_ - wifiStartUs_) / 1000), (long long)((wifiGotIpUs_ - wifiStartUs_) / 1000));
+}
+
+bool WeatherDisplay::reconnectWifi() {
+    if (connectCachedWifi()) {
+        return true;
+    }
+
+    // Uses the credentials stored by the WiFiManager
+    WiFi.mode(WIFI_STA);
+    wifiStartUs_ = esp_timer_get_time();
+    WiFi.begin();
+    int64_t deadline = wifiStartUs_ + WIFI_RECONNECT_TIMEOUT_MS * 1000LL;
+    while (WiFi.status() != WL_CONNECTED) {
+        if (esp_timer_get_time() > deadline) {
+            ESP_LOGW(TAG, "WiFi reconnect failed");
+            return false;
+        }
+        delay(10);
+    }
+    logWifiTimings("scan");
+    saveWifiCache();
+    return true;
+}
+
 void WeatherDisplay::initNtp() {
     configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER1, NTP_SERVER2);
 }
 
-void WeatherDisplay::displayStatus(const std::string& status, esp_err_t err) {
+void WeatherDisplay::displayStatus(const char* status, esp_err_t err) {
     display_.setFont(&FreeMonoBold18pt7b);
     display_.setTextColor(GxEPD_BLACK);
     display_.fillScreen(GxEPD_WHITE);
@@ -189,8 +483,12 @@ void WeatherDisplay::displayStatus(const std::string& status, esp_err_t err) {
         drawCenteredText(esp_err_to_name(err), error_y);
     }
 
+    display_.epd2.setPartialWaveform(GxEPD2_426_GDEQ0426T82Mod::WAVEFORM_STOCK);
     display_.display(true);
     display_.hibernate();
+    // The status replaced the dashboard in the controller RAM
+    frameWriter_.invalidate();
+    ghosting_.addFullChange();
 }
 
 void WeatherDisplay::generateApPassword() {
@@ -200,14 +498,14 @@ void WeatherDisplay::generateApPassword() {
     }
 }
 
-uint16_t WeatherDisplay::drawCenteredText(const std::string& text, int16_t y) {
+uint16_t WeatherDisplay::drawCenteredText(const char* text, int16_t y) {
     int16_t tbx, tby;
     uint16_t tbw, tbh;
 
-    display_.getTextBounds(text.c_str(), 0, 0, &tbx, &tby, &tbw, &tbh);
+    display_.getTextBounds(text, 0, 0, &tbx, &tby, &tbw, &tbh);
     int16_t x = (display_.width() - tbw) / 2 - tbx;
     display_.setCursor(x, y);
-    display_.print(text.c_str());
+    display_.print(text);
     return tbh;
 }
 
@@ -234,12 +532,12 @@ void WeatherDisplay::configModeCallback(WiFiManager* wifiManager) {
     // Draw AP name
     std::string ap_name = "SSID: " + getAPName();
     int16_t ap_y = center_y + 120; // Below QR code
-    tbh = drawCenteredText(ap_name, ap_y);
+    tbh = drawCenteredText(ap_name.c_str(), ap_y);
     
     // Draw password
     std::string ap_pass = "Pass: " + apPassword_;
     ap_y += tbh + 5; // Small gap between lines
-    tbh = drawCenteredText(ap_pass, ap_y);
+    tbh = drawCenteredText(ap_pass.c_str(), ap_y);
 
     // Draw IP address
     const char* ip = "http://192.168.4.1";
@@ -248,6 +546,8 @@ void WeatherDisplay::configModeCallback(WiFiManager* wifiManager) {
 
     display_.display(true);
     display_.hibernate();
+    frameWriter_.invalidate();
+    ghosting_.addFullChange();
 }
 
 // Initialize static members
@@ -289,29 +589,95 @@ void WeatherDisplay::drawQrcode(const std::string& text, int16_t x, int16_t y) {
     esp_qrcode_generate(&cfg, text.c_str());
 }
 
+bool WeatherDisplay::restoreState() {
+    if (!DEEP_SLEEP_BETWEEN_UPDATES || esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER ||
+        rtcState.magic != RTC_STATE_MAGIC) {
+        return false;
+    }
+
+    lastTarget_ = rtcState.lastTarget;
+    nextUpdate_ = rtcState.nextUpdate;
+    currentDashboardHash_ = rtcState.dashboardHash;
+    strlcpy(dashboardEtag_, rtcState.dashboardEtag, sizeof(dashboardEtag_));
+    downloadErrors_ = rtcState.downloadErrors;
+    contrastRedraws_ = rtcState.contrastRedraws;
+    fetchMs_ = rtcState.fetchMs;
+    std::copy(std::begin(rtcState.refreshMs), std::end(rtcState.refreshMs), refreshMs_);
+    wakeMs_ = rtcState.wakeMs;
+    cycles_ = rtcState.cycles;
+    ghosting_.restore(rtcState.ghosting);
+    return true;
+}
+
+void WeatherDisplay::saveState() const {
+    rtcState.magic = RTC_STATE_MAGIC;
+    rtcState.lastTarget = lastTarget_;
+    rtcState.nextUpdate = nextUpdate_;
+    rtcState.dashboardHash = currentDashboardHash_;
+    strlcpy(rtcState.dashboardEtag, dashboardEtag_, sizeof(rtcState.dashboardEtag));
+    rtcState.downloadErrors = downloadErrors_;
+    rtcState.contrastRedraws = contrastRedraws_;
+    rtcState.fetchMs = fetchMs_;
+    std::copy(std::begin(refreshMs_), std::end(refreshMs_), rtcState.refreshMs);
+    rtcState.wakeMs = wakeMs_;
+    rtcState.cycles = cycles_;
+    rtcState.ghosting = ghosting_.state();
+}
+
+void WeatherDisplay::deepSleepUntil(int64_t timeMs) {
+    // The controller must be back in deep sleep before the ESP turns off
+    if (display_.epd2.isRefreshing()) {
+        finishRefresh();
+    }
+    saveState();
+
+    // Wake up early enough to reconnect until the update has to start
+    int64_t sleepMs = timeMs - wakeMs_ - currentTimeMs();
+    ESP_LOGI(TAG, "deep sleep for %lld ms", (long long)sleepMs);
+    esp_sleep_enable_timer_wakeup(std::max<int64_t>(sleepMs, 0) * 1000);
+    esp_deep_sleep_start();
+}
+
 void WeatherDisplay::update() {
     // set to true to enter the fallback path if time is not available
     bool timeAvailable = true;
-    time_t lastUpdate = 0;
     while (true) {
         esp_task_wdt_reset();
 
         struct tm timeinfo;
         if (getLocalTime(&timeinfo)) {
             timeAvailable = true;
-            time_t now = mktime(&timeinfo);
-            
-            if (lastUpdate == 0 || (now / 60) != (lastUpdate / 60)) {
-                fetchAndDisplayDashboard();
-                lastUpdate = now;
-
-                // Nightly full refresh to remove ghosting
-                if (timeinfo.tm_hour == 3 && timeinfo.tm_min == 0) {
-                    display_.display(false);
-                    display_.hibernate();
-                }
+            int64_t now = currentTimeMs();
+
+            if (lastTarget_ == 0) {
+                // Show the dashboard as soon as possible after startup
+                lastTarget_ = now / 1000;
+                fetchAndDisplayDashboard(lastTarget_, false);
+                continue;
+            }
+
+            // The dashboard for a minute should be visible right when the minute starts, e.g.
+            // the new date at midnight. Thus, start early enough to finish fetching and
+            // refreshing until then.
+            time_t target = nextTarget(now);
+            struct tm targetinfo;
+            localtime_r(&target, &targetinfo);
+            bool fullRefresh = ghosting_.fullRefreshDue(targetinfo);
+            int64_t start = target * 1000LL - PREFETCH_MARGIN_MS - fetchMs_ - refreshTimeMs(fullRefresh);
+
+            if (now >= start) {
+                fetchAndDisplayDashboard(target, fullRefresh);
+                lastTarget_ = target;
+            } else if (DEEP_SLEEP_BETWEEN_UPDATES && start - now >= MIN_DEEP_SLEEP_MS) {
+                deepSleepUntil(start);
+            } else if (PUSH_UPDATES && !LOCAL_RENDERING && now >= pushRetryMs_ && recovery_.failures() == 0 &&
+                       start - now >= PUSH_MIN_WAIT_MS) {
+                // While recovering, only the scheduled updates retry
+                waitForPush(start);
+            } else {
+                // Wake up at least once per second to reset the watchdog
+                waitUntil(std::min(start, now - now % 1000 + 1000));
             }
-            waitNextSecond();
         } else if (timeAvailable) {
             displayStatus("No time available");
             timeAvailable = false;
@@ -320,67 +686,591 @@ void WeatherDisplay::update() {
     }
 }
 
-void WeatherDisplay::waitNextSecond() {
+int64_t WeatherDisplay::currentTimeMs() {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
-    int toSleep = 1000 - (ts.tv_nsec / 1000000);
-    delay(toSleep);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
 }
 
-void WeatherDisplay::fetchAndDisplayDashboard() {
+void WeatherDisplay::waitUntil(int64_t timeMs) {
+    int64_t toSleep;
+    while ((toSleep = timeMs - currentTimeMs()) > 0) {
+        if (!display_.epd2.isRefreshing()) {
+            delay(toSleep);
+            return;
+        }
+        if (display_.epd2.isBusy()) {
+            // Sleep until the BUSY interrupt signals the end of the refresh
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(toSleep));
+        } else {
+            finishRefresh();
+        }
+    }
+}
+
+time_t WeatherDisplay::nextTarget(int64_t now) const {
+    time_t target = (now / 60000 + 1) * 60;
+    if (target == lastTarget_) {
+        target += 60;
+    }
+    // Redraws of the unchanged dashboard don't wait for the server
+    if (nextUpdate_ == 0 || (contrastRedraws_ > 0 && recovery_.failures() == 0)) {
+        return target;
+    }
+
+    time_t hint = std::clamp(nextUpdate_, lastTarget_ + MIN_REFRESH_INTERVAL, lastTarget_ + MAX_REFRESH_INTERVAL);
+    hint = (hint + 59) / 60 * 60;
+
+    // Don't skip the quiet hours if a full refresh is pending
+    if (ghosting_.exceeded()) {
+        struct tm quiet;
+        localtime_r(&lastTarget_, &quiet);
+        if (GhostingBudget::isQuietTime(quiet)) {
+            return target;
+        }
+        if (quiet.tm_hour >= GhostingBudget::QUIET_HOUR_BEGIN) {
+            quiet.tm_mday++;
+        }
+        quiet.tm_hour = GhostingBudget::QUIET_HOUR_BEGIN;
+        quiet.tm_min = 0;
+        quiet.tm_sec = 0;
+        quiet.tm_isdst = -1;
+        hint = std::min(hint, mktime(&quiet));
+    }
+
+    return std::max(target, hint);
+}
+
+uint32_t WeatherDisplay::refreshTimeMs(bool fullRefresh, GxEPD2_426_GDEQ0426T82Mod::Waveform waveform) const {
+    return fullRefresh ? GxEPD2_426_GDEQ0426T82Mod::full_refresh_time : refreshMs_[waveform];
+}
+
+void WeatherDisplay::waitForPush(int64_t timeMs) {
+    // The request blocks the task, thus complete a running refresh first
+    if (display_.epd2.isRefreshing()) {
+        finishRefresh();
+    }
+    int64_t waitMs = std::min(timeMs - currentTimeMs(), PUSH_MAX_WAIT_MS);
+    if (waitMs < PUSH_MIN_WAIT_MS) {
+        return;
+    }
+    if (MULTICAST_UPDATES && (multicast_.active() || multicast_.begin(MULTICAST_GROUP, MULTICAST_PORT))) {
+        // Sleep until the server sends a new frame to the group
+        if (multicast_.waitForFrame(currentDashboardHash_, waitMs)) {
+            fetchAndDisplayDashboard(currentTimeMs() / 1000, false);
+        }
+        return;
+    }
+    // A pushed change is shown right away
+    fetchAndDisplayDashboard(currentTimeMs() / 1000, false, waitMs / 1000);
+}
+
+void WeatherDisplay::fetchAndDisplayDashboard(time_t target, bool fullRefresh, uint32_t waitS) {
     esp_pm_lock_acquire(pm_lock_);
-    String status = downloadDashboard();
-    if (status.isEmpty()) {
-        if (checkForDashboardChange()) {
-            displayDashboard();
-            identicalDraws_ = 1;
-        } else if (identicalDraws_ < 3) {
-            // Draw the same image three times to improve contrast
-            display_.display(true);
-            identicalDraws_++;
+    // The controller RAM retains the dashboard, thus redraws don't need the data again
+    bool conditional = !fullRefresh;
+    bool notModified = false;
+    int64_t fetchStart = currentTimeMs();
+    uint32_t ramBytes = display_.epd2.ramBytesWritten();
+    uint32_t ramWriteUs = display_.epd2.ramWriteMicros();
+    // The first chunk of a multicast frame has already arrived
+    bool multicast = multicast_.pending();
+    // Pushed changes arrive between the scheduled updates
+    bool pushed = waitS > 0 || multicast;
+    Error err = multicast         ? receiveMulticast()
+                : LOCAL_RENDERING ? renderDashboard(target, conditional)
+                                  : downloadDashboard(target, conditional, notModified, waitS);
+    uint32_t downloadMs = currentTimeMs() - fetchStart;
+    ramBytes = display_.epd2.ramBytesWritten() - ramBytes;
+    ramWriteUs = display_.epd2.ramWriteMicros() - ramWriteUs;
+    // The SPI writes block the CPU, compare their time with the download to see whether
+    // DMA would pay off
+    ESP_LOGD(TAG, "Download took %lu ms, %u strips changed, %lu bytes written to RAM in %lu us (%lu kB/s)",
+             (unsigned long)downloadMs, changedStrips_, (unsigned long)ramBytes, (unsigned long)ramWriteUs,
+             (unsigned long)(ramWriteUs ? ramBytes * 1000 / ramWriteUs : 0));
+    if (err == Error::NONE) {
+        // Waiting for a pushed change would distort the learned duration
+        if (!notModified && !pushed) {
+            // Learn how long fetching takes to start early enough next time
+            fetchMs_ = (3 * fetchMs_ + downloadMs) / 4;
+        }
+
+        if (!notModified && (checkForDashboardChange() || fullRefresh)) {
+            displayDashboard(target, fullRefresh);
+            contrastRedraws_ = CONTRAST_REDRAWS;
+        } else if (contrastRedraws_ > 0) {
+            // Refresh the unchanged dashboard from the controller RAM to improve contrast
+            displayDashboard(target, false);
+            contrastRedraws_--;
         }
         downloadErrors_ = 0;
+        recovery_.onSuccess(currentTimeMs());
+        cacheFrame(target);
+    } else if (pushed) {
+        // The next scheduled update follows shortly, thus a failed push neither climbs the
+        // recovery ladder nor replaces the dashboard by a status message
+        char status[64];
+        formatError(err, status, sizeof(status));
+        ESP_LOGW(TAG, "Push update failed: %s", status);
+        pushRetryMs_ = currentTimeMs() + PUSH_ERROR_RETRY_MS;
+        if (frameWriter_.modified()) {
+            // The controller RAM contains a mix of the old and the new frame, which no
+            // delta can be based on. Thus, request a full frame next time.
+            currentDashboardHash_ = 0;
+        }
     } else {
         downloadErrors_++;
-        if (downloadErrors_ > 5) {
-            // restart ESP if downloads continue to fail
-            // this is essentially a workaround in case some internal state is corrupted
-            ESP.restart();
+        char status[64];
+        formatError(err, status, sizeof(status));
+        auto action = recovery_.onFailure(currentTimeMs());
+        ESP_LOGW(TAG, "%s, recovery: %s", status, RecoveryLadder::name(action));
+        recover(action);
+        // Back off while the downloads continue to fail
+        nextUpdate_ = target + recovery_.retryDelay();
+        // Only a partially received frame or a reset controller lose the shown dashboard,
+        // otherwise the controller RAM still matches the panel. A delta may have failed
+        // after its first patches, thus any write counts, not only the last region.
+        bool ramIntact = !frameWriter_.modified() && currentDashboardHash_ != 0 &&
+                         action != RecoveryLadder::Action::REINIT_DISPLAY;
+        if (ramIntact) {
+            // Keep showing the last dashboard while the server is unreachable
+        } else if (restoreCachedFrame()) {
+            // The cached frame replaced a partially received one in the controller RAM
+            ESP_LOGI(TAG, "Continuing with the cached frame");
+        } else {
+            // The controller RAM may contain a partially received frame, thus request a
+            // full frame next time
+            currentDashboardHash_ = 0;
+            if (downloadErrors_ > 1 || downloadErrors_ == 0) {
+                // only show the error message if it's the second time to not disrupt the display on transient errors
+                // or the display is just starting up
+                displayStatus(status);
+                // The display no longer shows the dashboard, thus force a redraw
+                dashboardEtag_[0] = '\0';
+            }
         }
-        if (downloadErrors_ > 1 || downloadErrors_ == 0) {
-            // only show the error message if it's the second time to not disrupt the display on transient errors
-            // or the display is just starting up
-            displayStatus(status.c_str());
+    }
+    // The download wakes up the controller, send it back to sleep in any case. A running
+    // refresh continues without the lock, finishRefresh() hibernates once it completes.
+    if (!display_.epd2.isRefreshing()) {
+        display_.hibernate();
+    }
+    // Only the scheduled updates count as cycles, pushes occur at irregular intervals
+    if (!pushed) {
+        logHeapStats();
+#if CONFIG_PHASE_TRACE_ENABLE
+        if (cycles_ % TRACE_DUMP_INTERVAL == 0) {
+            PhaseTrace::logStats();
+            PhaseTrace::dump(stdout);
         }
+#endif
     }
+    // The controller RAM matches currentDashboardHash_ again, or the hash was reset
+    frameWriter_.resetModified();
 
     esp_pm_lock_release(pm_lock_);
 }
 
-String WeatherDisplay::downloadDashboard() {
-    HTTPClient http;
-    http.begin(String("http://")+DASHBOARD_SERVER+"/dashboard.pbm");
-    // 10 seconds timeout. The dashboard takes roughly 1 second to render on the server.
-    http.setTimeout(10000);
-    
-    int httpCode = http.GET();
+void WeatherDisplay::recover(RecoveryLadder::Action action) {
+    int64_t start = esp_timer_get_time();
+    switch (action) {
+    case RecoveryLadder::Action::RETRY:
+        break;
+    case RecoveryLadder::Action::RESET_CONNECTION:
+        connection_.close();
+        break;
+    case RecoveryLadder::Action::RECONNECT_WIFI:
+        connection_.close();
+        // The group membership doesn't survive the reconnect, join again on the next wait
+        multicast_.end();
+        WiFi.disconnect();
+        reconnectWifi();
+        break;
+    case RecoveryLadder::Action::REINIT_DISPLAY:
+        if (display_.epd2.isRefreshing()) {
+            finishRefresh();
+        }
+        initEpaper();
+        // The reset may have cleared the controller RAM
+        frameWriter_.invalidate();
+        currentDashboardHash_ = 0;
+        break;
+    default:
+        // The controller must be in deep sleep before the ESP restarts
+        if (display_.epd2.isRefreshing()) {
+            finishRefresh();
+        }
+        recovery_.onActionDone(action, (esp_timer_get_time() - start) / 1000);
+        recovery_.logStats();
+        ESP.restart();
+        return;
+    }
+    uint32_t durationMs = (esp_timer_get_time() - start) / 1000;
+    recovery_.onActionDone(action, durationMs);
+    ESP_LOGI(TAG, "Recovery step took %lu ms", (unsigned long)durationMs);
+}
+
+void WeatherDisplay::logHeapStats() {
+    // Once running, a cycle should not change the free heap
+    size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    int delta = lastFreeHeap_ == 0 ? 0 : (int)freeHeap - (int)lastFreeHeap_;
+    lastFreeHeap_ = freeHeap;
+    cycles_++;
+    // A leak shows up as new lows, a flat heap as a growing number of cycles since the last one
+    if (freeHeap < lowestFreeHeap_) {
+        lowestFreeHeap_ = freeHeap;
+        lowestFreeHeapCycle_ = cycles_;
+    }
+
+    auto level = cycles_ % HEAP_LOG_INTERVAL == 0 ? ESP_LOG_INFO : ESP_LOG_DEBUG;
+    ESP_LOG_LEVEL_LOCAL(level, TAG,
+                        "heap free %u (%+d), lowest %u %lu cycles ago, minimum free %u, largest free block %u",
+                        (unsigned)freeHeap, delta, (unsigned)lowestFreeHeap_,
+                        (unsigned long)(cycles_ - lowestFreeHeapCycle_),
+                        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+                        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+void WeatherDisplay::formatError(Error err, char* buf, size_t len) const {
+    switch (err) {
+    case Error::DOWNLOAD_FAILED:
+        snprintf(buf, len, "Dashboard download failed: %d", errorDetail_[0]);
+        break;
+    case Error::INVALID_PBM_FORMAT:
+        snprintf(buf, len, "Invalid PBM format");
+        break;
+    case Error::INVALID_PBM_DIMENSIONS:
+        snprintf(buf, len, "Invalid PBM dimensions");
+        break;
+    case Error::INVALID_PBM_SIZE:
+        snprintf(buf, len, "Invalid size: %dx%d", errorDetail_[0], errorDetail_[1]);
+        break;
+    case Error::INVALID_DELTA:
+        snprintf(buf, len, "Invalid delta");
+        break;
+    case Error::INVALID_DELTA_PATCH:
+        snprintf(buf, len, "Invalid delta patch");
+        break;
+    case Error::STREAM_DISCONNECTED:
+        snprintf(buf, len, "Stream disconnected");
+        break;
+    case Error::INVALID_MULTICAST_CHUNK:
+        snprintf(buf, len, "Invalid multicast chunk");
+        break;
+    case Error::INVALID_MULTICAST_FRAME:
+        snprintf(buf, len, "Invalid multicast frame");
+        break;
+    case Error::INVALID_DASHBOARD_DATA:
+        snprintf(buf, len, "Invalid dashboard data");
+        break;
+    case Error::INVALID_GLYPH:
+        snprintf(buf, len, "Invalid glyph");
+        break;
+    default:
+        snprintf(buf, len, "Error %d", (int)err);
+        break;
+    }
+}
+
+Error WeatherDisplay::downloadDashboard(time_t target, bool conditional, bool& notModified, uint32_t waitS) {
+    changedStrips_ = 0;
+    frameWriter_.resetFlippedPixels();
+    connection_.begin("/dashboard.delta", waitS * 1000);
+    HTTPClient& http = connection_.http();
+
+    if (waitS > 0) {
+        char wait[12];
+        snprintf(wait, sizeof(wait), "%lu", (unsigned long)waitS);
+        http.addHeader("X-Wait", wait);
+    }
+
+    // Let the server render the dashboard for the time at which it will be shown
+    char frameTime[24];
+    snprintf(frameTime, sizeof(frameTime), "%lld", (long long)target);
+    http.addHeader("X-Frame-Time", frameTime);
+
+    static const char* headerKeys[] = {"ETag", "X-Frame-Encoding", "X-Frame-Type", "X-Frame-Hash",
+                                       "X-Next-Update", "Cache-Control", "X-Long-Poll"};
+    connection_.collectHeaders(headerKeys, std::size(headerKeys));
+    http.addHeader("X-Frame-Encoding", DASHBOARD_ENCODING);
+    if (conditional && dashboardEtag_[0] != '\0') {
+        http.addHeader("If-None-Match", dashboardEtag_);
+    }
+    if (currentDashboardHash_ != 0) {
+        // The controller RAM still contains this frame, thus only changes are necessary
+        char baseHash[9];
+        snprintf(baseHash, sizeof(baseHash), "%08lx", (unsigned long)currentDashboardHash_);
+        http.addHeader("X-Frame-Base", baseHash);
+    }
+
+    // Don't keep the CPU at full speed while the server holds the request, which takes
+    // most of the watchdog timeout
+    if (waitS > 0) {
+        esp_pm_lock_release(pm_lock_);
+        esp_task_wdt_reset();
+    }
+    int httpCode = connection_.get();
+    if (waitS > 0) {
+        esp_pm_lock_acquire(pm_lock_);
+        esp_task_wdt_reset();
+        if (httpCode > 0 && !connection_.hasHeader("X-Long-Poll")) {
+            ESP_LOGW(TAG, "Server does not support push updates, polling only");
+            pushRetryMs_ = currentTimeMs() + PUSH_RETRY_INTERVAL_MS;
+        }
+    }
+    parseRefreshHint();
+    if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        notModified = true;
+        connection_.end(true);
+        return Error::NONE;
+    }
+    if (httpCode != HTTP_CODE_OK) {
+        errorDetail_[0] = httpCode;
+        connection_.end(false);
+        return Error::DOWNLOAD_FAILED;
+    }
+
+    // Forget the old ETag until the new dashboard is completely downloaded
+    dashboardEtag_[0] = '\0';
+
+    WiFiClient* stream = connection_.stream();
+    Error err;
+    {
+        PHASE_TRACE_SCOPE(BODY_RECEIVE);
+        if (connection_.headerEquals("X-Frame-Type", "delta")) {
+            err = receiveDelta(stream);
+            downloadedHash_ = strtoul(connection_.header("X-Frame-Hash"), nullptr, 16);
+        } else {
+            // The server falls back to uncompressed pixel data if it doesn't support the encoding
+            err = receiveFrame(stream, connection_.headerEquals("X-Frame-Encoding", DASHBOARD_ENCODING));
+            downloadedHash_ = frameWriter_.hash();
+        }
+    }
+
+    if (err == Error::NONE) {
+        strlcpy(dashboardEtag_, connection_.header("ETag"), sizeof(dashboardEtag_));
+    }
+    connection_.end(err == Error::NONE);
+    return err;
+}
+
+Error WeatherDisplay::receiveMulticast() {
+    multicast_.receive(MULTICAST_GAP_MS);
+
+    // Request the chunks lost on the way individually
+    Error err = Error::NONE;
+    uint16_t requested = 0;
+    for (uint16_t i = multicast_.nextMissing(0); i < multicast_.count() && err == Error::NONE;
+         i = multicast_.nextMissing(i + 1)) {
+        err = requestChunk(i);
+        requested++;
+    }
+
+    changedStrips_ = multicast_.changedStrips();
+    downloadedHash_ = multicast_.hash();
+    // The ETag is unknown, the next download only transfers the changes nevertheless
+    dashboardEtag_[0] = '\0';
+    if (err == Error::NONE && (!multicast_.complete() || frameWriter_.frameHash() != downloadedHash_)) {
+        err = Error::INVALID_MULTICAST_FRAME;
+    }
+    ESP_LOGI(TAG, "Multicast frame %08lx, %u chunks requested", (unsigned long)downloadedHash_, requested);
+    multicast_.logStats();
+    multicast_.reset();
+    return err;
+}
+
+Error WeatherDisplay::requestChunk(uint16_t index) {
+    char path[32];
+    snprintf(path, sizeof(path), "/dashboard.chunk/%08lx/%u", (unsigned long)multicast_.hash(), index);
+    connection_.begin(path);
+    int httpCode = connection_.get();
     if (httpCode != HTTP_CODE_OK) {
-        char statusMsg[64];
-        snprintf(statusMsg, sizeof(statusMsg), "Dashboard download failed: %d", httpCode);
-        http.end();
-        return statusMsg;
+        errorDetail_[0] = httpCode;
+        connection_.end(false);
+        return Error::DOWNLOAD_FAILED;
     }
 
+    // The response is the datagram that got lost
+    WiFiClient* stream = connection_.stream();
+    uint8_t* packet = multicast_.packet();
+    size_t len = 0;
+    while (len < MulticastReceiver::PACKET_BYTES) {
+        size_t available = connection_.waitForData();
+        if (available == 0) {
+            connection_.end(false);
+            return Error::STREAM_DISCONNECTED;
+        }
+        int read = stream->read(packet + len, std::min(available, MulticastReceiver::PACKET_BYTES - len));
+        if (read > 0) {
+            len += read;
+        }
+    }
+    connection_.end(true);
+    return multicast_.handlePacket(len) ? Error::NONE : Error::INVALID_MULTICAST_CHUNK;
+}
+
+Error WeatherDisplay::renderDashboard(time_t target, bool conditional) {
+    Error err = downloadDashboardData(conditional);
+    if (err != Error::NONE) {
+        return err;
+    }
+
+    // Icons are downloaded once, the layout depends on their size
+    struct tm timeinfo;
+    localtime_r(&target, &timeinfo);
+    for (int requests = 0; !renderer_.layout(data_, timeinfo); requests++) {
+        if (renderer_.overflow()) {
+            return Error::INVALID_DASHBOARD_DATA;
+        }
+        if (requests == MAX_GLYPH_REQUESTS) {
+            return Error::INVALID_GLYPH;
+        }
+        err = requestGlyph(renderer_.missingIcon(), renderer_.missingIconSize());
+        if (err != Error::NONE) {
+            return err;
+        }
+    }
+
+    // Render even if the values are unchanged, as the date changes at midnight
+    frameWriter_.resetFlippedPixels();
+    renderer_.render(frameWriter_);
+    changedStrips_ = frameWriter_.changedStrips();
+    downloadedHash_ = frameWriter_.hash();
+    // Allows caching the frame, the bitmap download doesn't run in this mode
+    strlcpy(dashboardEtag_, dataEtag_, sizeof(dashboardEtag_));
+    return Error::NONE;
+}
+
+Error WeatherDisplay::downloadDashboardData(bool conditional) {
+    connection_.begin("/dashboard.data");
+    HTTPClient& http = connection_.http();
+    static const char* headerKeys[] = {"ETag", "X-Next-Update", "Cache-Control"};
+    connection_.collectHeaders(headerKeys, std::size(headerKeys));
+    if (conditional && dataEtag_[0] != '\0') {
+        http.addHeader("If-None-Match", dataEtag_);
+    }
+
+    int httpCode = connection_.get();
+    parseRefreshHint();
+    if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        connection_.end(true);
+        return Error::NONE;
+    }
+    if (httpCode != HTTP_CODE_OK) {
+        errorDetail_[0] = httpCode;
+        connection_.end(false);
+        return Error::DOWNLOAD_FAILED;
+    }
+
+    dataEtag_[0] = '\0';
+    int size = http.getSize();
+    if (size <= 0 || size > (int)MAX_DASHBOARD_DATA_BYTES) {
+        connection_.end(false);
+        return Error::INVALID_DASHBOARD_DATA;
+    }
+    // Too large for the stack of the main task
+    static uint8_t payload[MAX_DASHBOARD_DATA_BYTES];
+    WiFiClient* stream = connection_.stream();
+    int len = 0;
+    while (len < size) {
+        size_t available = connection_.waitForData();
+        if (available == 0) {
+            connection_.end(false);
+            return Error::STREAM_DISCONNECTED;
+        }
+        int read = stream->read(payload + len, std::min<size_t>(available, size - len));
+        if (read > 0) {
+            len += read;
+        }
+    }
+
+    connection_.end(true);
+    if (!data_.parse(payload, len)) {
+        return Error::INVALID_DASHBOARD_DATA;
+    }
+    strlcpy(dataEtag_, connection_.header("ETag"), sizeof(dataEtag_));
+    return Error::NONE;
+}
+
+Error WeatherDisplay::requestGlyph(const char* name, uint16_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "/dashboard.glyph/%s/%u", name, size);
+    connection_.begin(path);
+    static const char* headerKeys[] = {"X-Glyph-Advance"};
+    connection_.collectHeaders(headerKeys, std::size(headerKeys));
+    int httpCode = connection_.get();
+    if (httpCode != HTTP_CODE_OK) {
+        errorDetail_[0] = httpCode;
+        connection_.end(false);
+        return Error::DOWNLOAD_FAILED;
+    }
+
+    // The icon is a PBM image without comments, padded to full bytes
+    WiFiClient* stream = connection_.stream();
+    char magic[8];
+    char dimensions[16];
+    size_t magicLen = stream->readBytesUntil('\n', magic, sizeof(magic) - 1);
+    magic[magicLen] = '\0';
+    size_t dimensionsLen = stream->readBytesUntil('\n', dimensions, sizeof(dimensions) - 1);
+    dimensions[dimensionsLen] = '\0';
+    int width, height;
+    if (strcmp(magic, "P4") != 0 || sscanf(dimensions, "%d %d", &width, &height) != 2 || width <= 0 ||
+        height <= 0 || width % 8 != 0) {
+        connection_.end(false);
+        return Error::INVALID_GLYPH;
+    }
+    int advance = connection_.hasHeader("X-Glyph-Advance") ? atoi(connection_.header("X-Glyph-Advance")) : width;
+
+    uint8_t* bitmap = glyphs_.add(name, size, width, height, advance);
+    if (bitmap == nullptr) {
+        // Make room, the icons of the current layout are downloaded again if necessary
+        glyphs_.clear();
+        bitmap = glyphs_.add(name, size, width, height, advance);
+        if (bitmap == nullptr) {
+            connection_.end(false);
+            return Error::INVALID_GLYPH;
+        }
+    }
+    size_t bytes = width / 8 * height;
+    size_t len = 0;
+    while (len < bytes) {
+        size_t available = connection_.waitForData();
+        if (available == 0) {
+            connection_.end(false);
+            return Error::STREAM_DISCONNECTED;
+        }
+        int read = stream->read(bitmap + len, std::min(available, bytes - len));
+        if (read > 0) {
+            len += read;
+        }
+    }
+    connection_.end(true);
+    glyphs_.commit();
+    return Error::NONE;
+}
+
+void WeatherDisplay::parseRefreshHint() {
+    nextUpdate_ = 0;
+    if (connection_.hasHeader("X-Next-Update")) {
+        nextUpdate_ = strtoll(connection_.header("X-Next-Update"), nullptr, 10);
+        return;
+    }
+    // Fall back to the standard header, which is relative to the time of the response
+    const char* maxAge = strstr(connection_.header("Cache-Control"), "max-age=");
+    if (maxAge != nullptr) {
+        nextUpdate_ = currentTimeMs() / 1000 + strtol(maxAge + 8, nullptr, 10);
+    }
+}
+
+Error WeatherDisplay::receiveFrame(WiFiClient* stream, bool packBits) {
     // Read PBM header
-    WiFiClient* stream = http.getStreamPtr();
     char header[64];
     size_t headerLen = stream->readBytesUntil('\n', header, sizeof(header) - 1);
     header[headerLen] = '\0';
     
     // Verify PBM magic number
     if (strncmp(header, "P4", 2) != 0) {
-        http.end();
-        return "Invalid PBM format";
+        return Error::INVALID_PBM_FORMAT;
     }
 
     // Skip comments
@@ -393,65 +1283,81 @@ String WeatherDisplay::downloadDashboard() {
     // Parse dimensions
     int width, height;
     if (sscanf(header, "%d %d", &width, &height) != 2) {
-        http.end();
-        return "Invalid PBM dimensions";
+        return Error::INVALID_PBM_DIMENSIONS;
     }
 
     // Verify dimensions match expected size
-    if (width != display_.width() || height != display_.height()) {
-        char statusMsg[64];
-        snprintf(statusMsg, sizeof(statusMsg), "Invalid size: %dx%d", width, height);
-        http.end();
-        return statusMsg;
+    if (width != FrameWriter::WIDTH || height != FrameWriter::HEIGHT) {
+        errorDetail_[0] = width;
+        errorDetail_[1] = height;
+        return Error::INVALID_PBM_SIZE;
     }
 
-    // Calculate expected size (PBM is 1 bit per pixel, packed into bytes)
-    size_t expectedSize = (width * height + 7) / 8;
+    frameWriter_.begin();
+    return receivePixels(stream, packBits);
+}
 
-    // Allocate buffer for the PBM data
-    if (dashboardBuffer_ == nullptr || dashboardBufferSize_ < expectedSize) {
-        if (dashboardBuffer_ != nullptr) {
-            free(dashboardBuffer_);
+Error WeatherDisplay::receiveDelta(WiFiClient* stream) {
+    // All numbers are 16 bit little endian, see computeDelta() in the server
+    uint8_t count[2];
+    if (stream->readBytes(count, sizeof(count)) != sizeof(count)) {
+        return Error::INVALID_DELTA;
+    }
+
+    for (uint16_t i = 0; i < (count[0] | (count[1] << 8)); i++) {
+        uint8_t raw[8];
+        if (stream->readBytes(raw, sizeof(raw)) != sizeof(raw)) {
+            return Error::INVALID_DELTA;
+        }
+        uint16_t x = raw[0] | (raw[1] << 8);
+        uint16_t y = raw[2] | (raw[3] << 8);
+        uint16_t w = raw[4] | (raw[5] << 8);
+        uint16_t h = raw[6] | (raw[7] << 8);
+        if (w == 0 || h == 0 || (x | y | w | h) % 8 != 0 ||
+            x + w > FrameWriter::WIDTH || y + h > FrameWriter::HEIGHT) {
+            return Error::INVALID_DELTA_PATCH;
         }
-        dashboardBuffer_ = (uint8_t*)malloc(expectedSize);
-        if (dashboardBuffer_ == nullptr) {
-            http.end();
-            return "Memory allocation failed";
+
+        frameWriter_.begin(x, y, w, h);
+        Error err = receivePixels(stream, false);
+        if (err != Error::NONE) {
+            return err;
         }
-        dashboardBufferSize_ = expectedSize;
     }
+    return Error::NONE;
+}
 
-    // Download the PBM data
-    size_t bytesRead = 0;
-    while (bytesRead < expectedSize) {
-        if (!stream->connected()) {
-            http.end();
-            return "Stream disconnected";
+Error WeatherDisplay::receivePixels(WiFiClient* stream, bool packBits) {
+    // Stream the PBM data into the controller RAM while it arrives
+    packBitsDecoder_.begin();
+    uint8_t chunk[256];
+    while (!frameWriter_.complete()) {
+        // Blocks until data arrives
+        size_t available = connection_.waitForData();
+        if (available == 0) {
+            return Error::STREAM_DISCONNECTED;
         }
-        size_t available = stream->available();
-        if (available) {
-            size_t read = stream->readBytes(dashboardBuffer_ + bytesRead, available);
-            bytesRead += read;
+        // The data is already available, thus read it in one go
+        if (packBits) {
+            int read = stream->read(chunk, std::min(available, sizeof(chunk)));
+            if (read > 0) {
+                packBitsDecoder_.write(chunk, read);
+            }
         } else {
-            delay(1);
+            size_t toRead = std::min({available, frameWriter_.remaining(), sizeof(chunk)});
+            int read = stream->read(chunk, toRead);
+            if (read > 0) {
+                frameWriter_.write(chunk, read);
+            }
         }
     }
-
-    http.end();
-
-    if (bytesRead != expectedSize) {
-        return "Invalid PBM size";
-    }
-    return "";
+    changedStrips_ += frameWriter_.changedStrips();
+    return Error::NONE;
 }
 
 bool WeatherDisplay::checkForDashboardChange() {
-    // Calculate hash of the new dashboard content
-    // A simple hash function is good enough
-    uint32_t newHash = 0;
-    for (size_t i = 0; i < dashboardBufferSize_; i++) {
-        newHash = (newHash * 31) + dashboardBuffer_[i];
-    }
+    // The hash is calculated while streaming the dashboard or provided by the server
+    uint32_t newHash = downloadedHash_;
 
     // Only update if the content has changed
     if (newHash != currentDashboardHash_) {
@@ -462,12 +1368,46 @@ bool WeatherDisplay::checkForDashboardChange() {
     return false;
 }
 
-void WeatherDisplay::displayDashboard() {
-    // Display the image. 1 = black, 0 = white.
-    display_.fillScreen(GxEPD_WHITE);
-    // only sets the pixels that have 1 in the buffer
-    display_.drawBitmap(0, 0, dashboardBuffer_, display_.width(), display_.height(), GxEPD_BLACK);
-    display_.display(true);
+void WeatherDisplay::displayDashboard(time_t target, bool fullRefresh) {
+    // Redraws of an unchanged dashboard should improve the contrast, thus use the stock waveform
+    auto waveform = changedStrips_ > 0 && changedStrips_ <= SMALL_CHANGE_STRIPS
+        ? smallChangeWaveform_ : GxEPD2_426_GDEQ0426T82Mod::WAVEFORM_STOCK;
+
+    // Finish the refresh right when the target time is reached
+    waitUntil(target * 1000LL - refreshTimeMs(fullRefresh, waveform));
+    display_.epd2.setPartialWaveform(waveform);
+
+    if (fullRefresh) {
+        ghosting_.addFullRefresh();
+    } else {
+        ghosting_.addPartialRefresh(frameWriter_.flippedPixels());
+        ESP_LOGD(TAG, "Ghosting budget used: %lu%% flips, %lu%% refreshes", (unsigned long)ghosting_.flipUsage(),
+                 (unsigned long)ghosting_.refreshUsage());
+    }
+
+    // The controller RAM already contains the dashboard. Don't block while the panel
+    // refreshes, the BUSY interrupt wakes up waitUntil() afterwards.
+    refreshStart_ = currentTimeMs();
+    refreshFull_ = fullRefresh;
+    display_.epd2.refreshAsync(!fullRefresh, xTaskGetCurrentTaskHandle());
+}
+
+void WeatherDisplay::finishRefresh() {
+    display_.epd2.finishRefresh();
+    uint32_t durationMs = currentTimeMs() - refreshStart_;
+    if (wokeFromSleep_) {
+        // esp_timer starts when waking up from deep sleep
+        ESP_LOGI(TAG, "Wake to pixels took %lld ms", (long long)(esp_timer_get_time() / 1000));
+        wokeFromSleep_ = false;
+    }
+    if (!refreshFull_) {
+        auto waveform = display_.epd2.partialWaveform();
+        refreshMs_[waveform] = (3 * refreshMs_[waveform] + durationMs) / 4;
+        ESP_LOGI(TAG, "Partial refresh with waveform %d took %lu ms, avg %lu ms", waveform,
+                 (unsigned long)durationMs, (unsigned long)refreshMs_[waveform]);
+    } else {
+        ESP_LOGI(TAG, "Full refresh took %lu ms", (unsigned long)durationMs);
+    }
     display_.hibernate();
 }
 } // namespace ClockDisplay
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <iterator>
 #include <string>
 #include <GxEPD2_BW.h>
 #include <GxEPD2_426_GDEQ0426T82Mod.h>
@@ -8,6 +10,16 @@
 #include <qrcode.h>
 
 #include "board.h"
+#include "connection.h"
+#include "dashboard_data.h"
+#include "dashboard_renderer.h"
+#include "frame_cache.h"
+#include "frame_writer.h"
+#include "ghosting_budget.h"
+#include "glyph_cache.h"
+#include "multicast_receiver.h"
+#include "packbits.h"
+#include "recovery_ladder.h"
 
 // Forward declaration of WiFiManager class
 class WiFiManager;
@@ -25,14 +37,101 @@ constexpr auto GMT_OFFSET_SEC = 3600;
 constexpr auto DAYLIGHT_OFFSET_SEC = 3600;
 
 constexpr auto DASHBOARD_SERVER = "192.168.178.202:3000";
-constexpr auto DASHBOARD_REFRESH_INTERVAL = 60000; // 1 minute in milliseconds
+// Compression of the PBM pixel data requested from the server, see packbits.h
+constexpr auto DASHBOARD_ENCODING = "packbits";
+// Bounds in seconds for the update interval requested by the server via X-Next-Update or
+// Cache-Control. Without a hint, the dashboard is updated once per minute.
+constexpr time_t MIN_REFRESH_INTERVAL = 60;
+constexpr time_t MAX_REFRESH_INTERVAL = 15 * 60;
+// Render the dashboard on the display from the values provided by the server instead of
+// downloading the bitmap rendered by the server. The layout mirrors the server's template,
+// changes to it need to be replicated in DashboardRenderer.
+constexpr bool LOCAL_RENDERING = false;
+// Upper limit for the size of the dashboard values
+constexpr size_t MAX_DASHBOARD_DATA_BYTES = 512;
+// Icons downloaded per update at most, guards against a glyph cache that is too small
+constexpr int MAX_GLYPH_REQUESTS = 16;
+// Safety margin when starting the dashboard update before the minute starts. The dashboard
+// shows no clock, only the date at midnight and the server's X-Next-Update times are due at
+// a known minute, the sensor values change at any time.
+constexpr auto PREFETCH_MARGIN_MS = 500;
+// Waveform for refreshes with only small changes such as a new sensor value. Use
+// WAVEFORM_STOCK to fall back to the default waveform. A LUT stored as blob under
+// WAVEFORM_LUT_KEY in the NVS namespace "storage" replaces it by WAVEFORM_CUSTOM.
+constexpr auto SMALL_CHANGE_WAVEFORM = GxEPD2_426_GDEQ0426T82Mod::WAVEFORM_FAST;
+constexpr auto WAVEFORM_LUT_KEY = "waveform_lut";
+// Changes of up to this number of 8 pixel high strips count as small
+constexpr uint16_t SMALL_CHANGE_STRIPS = 16;
+// Additional refreshes of an unchanged dashboard with the stock waveform to improve contrast
+constexpr uint32_t CONTRAST_REDRAWS = 1;
+
+// Log the heap usage roughly once per hour
+constexpr uint32_t HEAP_LOG_INTERVAL = 60;
+// Wait for changes pushed by the server between the scheduled updates. The server holds
+// the request until the dashboard changes (long-poll).
+constexpr bool PUSH_UPDATES = true;
+// Watchdog timeout once WiFi is connected
+constexpr uint32_t WDT_TIMEOUT_MS = 30000;
+// Upper limit for holding a request, must stay well below the watchdog timeout
+constexpr int64_t PUSH_MAX_WAIT_MS = 15000;
+static_assert(DashboardConnection::maxBlockingMs(PUSH_MAX_WAIT_MS) < WDT_TIMEOUT_MS,
+              "a long-poll must not trigger the watchdog");
+// Skip waiting for changes if the next scheduled update is closer than this
+constexpr int64_t PUSH_MIN_WAIT_MS = 3000;
+// Try again after the server did not support push updates
+constexpr int64_t PUSH_RETRY_INTERVAL_MS = 60 * 60 * 1000;
+// Pause waiting for changes after a failed push, the scheduled updates continue
+constexpr int64_t PUSH_ERROR_RETRY_MS = 5 * 60 * 1000;
+
+// Receive pushed changes via multicast instead of long-poll. The server sends each new
+// frame once for all displays, see MULTICAST_GROUP in the server configuration.
+constexpr bool MULTICAST_UPDATES = false;
+constexpr auto MULTICAST_GROUP = "239.255.42.1";
+constexpr uint16_t MULTICAST_PORT = 3001;
+// Request the missing chunks once no datagram arrived for this long
+constexpr uint32_t MULTICAST_GAP_MS = 300;
+
+// Minimum time between writes of the frame cache in seconds, limits the flash wear. Each
+// write erases the 12 sectors of one of the two slots, thus every sector is erased at most
+// 24 times a day, which stays within 100k erase cycles for more than 10 years.
+constexpr time_t FRAME_CACHE_INTERVAL = 30 * 60;
+
+// With CONFIG_PHASE_TRACE_ENABLE, dump the trace every few cycles before the ring buffer
+// overflows
+constexpr uint32_t TRACE_DUMP_INTERVAL = 4;
+
+// Deep sleep between updates instead of waiting. This drops the WiFi connection and the
+// frame copy of the FrameWriter, thus each update has to reconnect and changes can only
+// be skipped based on the deltas provided by the server.
+constexpr bool DEEP_SLEEP_BETWEEN_UPDATES = false;
+// Only enter deep sleep if the next update is at least this far away
+constexpr int64_t MIN_DEEP_SLEEP_MS = 5000;
+// Give up on reconnecting with the stored credentials after this time
+constexpr uint32_t WIFI_RECONNECT_TIMEOUT_MS = 10000;
+// Give up on connecting to the cached access point after this time, then scan again
+constexpr uint32_t WIFI_CACHED_TIMEOUT_MS = 3000;
+// Also reuse the last IP configuration instead of DHCP. Only enable this if the router
+// reserves the address for the display.
+constexpr bool WIFI_CACHE_STATIC_IP = false;
 
 // Error codes
 enum class Error {
     NONE = 0,
     NVS_INIT_FAILED,
     WIFI_CONNECT_FAILED,
-    WIFI_PASSWORD_FAILED
+    WIFI_PASSWORD_FAILED,
+    // Dashboard download errors, see formatError()
+    DOWNLOAD_FAILED,
+    INVALID_PBM_FORMAT,
+    INVALID_PBM_DIMENSIONS,
+    INVALID_PBM_SIZE,
+    INVALID_DELTA,
+    INVALID_DELTA_PATCH,
+    STREAM_DISCONNECTED,
+    INVALID_MULTICAST_CHUNK,
+    INVALID_MULTICAST_FRAME,
+    INVALID_DASHBOARD_DATA,
+    INVALID_GLYPH
 };
 
 class WeatherDisplay {
@@ -43,18 +142,41 @@ public:
     void update();
 
 private:
-    WeatherDisplay() : display_(GxEPD2_426_GDEQ0426T82Mod(TFT_CS, TFT_DC, TFT_RST, TFT_BUSY)) {}
+    WeatherDisplay()
+        : display_(GxEPD2_426_GDEQ0426T82Mod(TFT_CS, TFT_DC, TFT_RST, TFT_BUSY)), connection_(DASHBOARD_SERVER),
+          frameWriter_(display_.epd2), packBitsDecoder_(frameWriter_), multicast_(frameWriter_), renderer_(glyphs_),
+          recovery_(recoveryState()) {
+        std::fill(std::begin(refreshMs_), std::end(refreshMs_), GxEPD2_426_GDEQ0426T82Mod::partial_refresh_time);
+    }
     ~WeatherDisplay() = default;
     WeatherDisplay(const WeatherDisplay&) = delete;
     WeatherDisplay& operator=(const WeatherDisplay&) = delete;
 
     void initEpaper();
+    // Logs the time of a full frame write with per-byte and with bulk SPI transfers
+    void benchmarkSpi();
+    // Show the cached dashboard instead of clearing the screen
+    bool showCachedFrame();
+    // Restore the cached dashboard into the controller RAM
+    bool restoreCachedFrame();
+    void cacheFrame(time_t target);
     Error initNvs();
+    // Select WAVEFORM_CUSTOM for small changes if a LUT is stored in NVS
+    void loadWaveformLut();
     Error initWifiPassword();
     Error initWifi();
+    bool reconnectWifi();
+    bool connectCachedWifi();
+    void saveWifiCache();
+    void logWifiTimings(const char* method);
     void initNtp();
 
-    void displayStatus(const std::string& status, esp_err_t err = ESP_OK);
+    // Deep sleep support, the state that survives deep sleep is kept in RTC memory
+    bool restoreState();
+    void saveState() const;
+    void deepSleepUntil(int64_t timeMs);
+
+    void displayStatus(const char* status, esp_err_t err = ESP_OK);
     void generateApPassword();
     void configModeCallback(WiFiManager* wifiManager);
 
@@ -63,27 +185,99 @@ private:
     void drawQrcode(const std::string& text, int16_t x, int16_t y);
 
     // update loop helpers
-    void waitNextSecond();
+    static int64_t currentTimeMs();
+    // Also finishes a running refresh while waiting
+    void waitUntil(int64_t timeMs);
+    // Time of the next dashboard update, based on the server's hint if available
+    time_t nextTarget(int64_t now) const;
+    uint32_t refreshTimeMs(bool fullRefresh,
+                           GxEPD2_426_GDEQ0426T82Mod::Waveform waveform = GxEPD2_426_GDEQ0426T82Mod::WAVEFORM_STOCK) const;
 
     // Dashboard related methods
-    void fetchAndDisplayDashboard();
-    String downloadDashboard();
+    // With waitS > 0, the server may hold the request until the dashboard changes
+    void fetchAndDisplayDashboard(time_t target, bool fullRefresh, uint32_t waitS = 0);
+    Error downloadDashboard(time_t target, bool conditional, bool& notModified, uint32_t waitS);
+    // Wait for a pushed change until the given time
+    void waitForPush(int64_t timeMs);
+    // Complete the pending multicast frame, missing chunks are requested via unicast
+    Error receiveMulticast();
+    Error requestChunk(uint16_t index);
+    // Render the dashboard from the values provided by the server, see LOCAL_RENDERING
+    Error renderDashboard(time_t target, bool conditional);
+    Error downloadDashboardData(bool conditional);
+    Error requestGlyph(const char* name, uint16_t size);
+    void parseRefreshHint();
+    Error receiveFrame(WiFiClient* stream, bool packBits);
+    Error receiveDelta(WiFiClient* stream);
+    Error receivePixels(WiFiClient* stream, bool packBits);
+    // Describe a dashboard error including its details without allocating memory
+    void formatError(Error err, char* buf, size_t len) const;
+    void logHeapStats();
+    // Take a step of the recovery ladder after a failed download
+    void recover(RecoveryLadder::Action action);
+    // Ladder state in memory that survives restarts
+    static RecoveryLadder::State& recoveryState();
     bool checkForDashboardChange();
-    void displayDashboard();
+    void displayDashboard(time_t target, bool fullRefresh);
+    void finishRefresh();
 
     // Helper method for drawing centered text
     // Returns the text height for vertical spacing calculations
-    uint16_t drawCenteredText(const std::string& text, int16_t y);
+    uint16_t drawCenteredText(const char* text, int16_t y);
 
     GxEPD2_BW<GxEPD2_426_GDEQ0426T82Mod, GxEPD2_426_GDEQ0426T82Mod::HEIGHT> display_;
     std::string apPassword_;
 
     esp_pm_lock_handle_t pm_lock_ = nullptr;
     int downloadErrors_ = -1; // -1 means first download
-    uint8_t* dashboardBuffer_ = nullptr;
-    size_t dashboardBufferSize_ = 0;
+    // Details of the last download error, e.g. the HTTP status code
+    int errorDetail_[2] = {};
+    uint32_t cycles_ = 0;
+    size_t lastFreeHeap_ = 0;
+    // Lowest free heap after a cycle and the cycle in which it occurred
+    size_t lowestFreeHeap_ = SIZE_MAX;
+    uint32_t lowestFreeHeapCycle_ = 0;
+    time_t lastTarget_ = 0;
+    // Time of the next change announced by the server, 0 if unknown
+    time_t nextUpdate_ = 0;
+    // Time at which push updates are tried again, 0 if supported by the server
+    int64_t pushRetryMs_ = 0;
+    // Learned duration from waking up until WiFi is connected
+    uint32_t wakeMs_ = 1000;
+    bool wokeFromSleep_ = false;
+    // esp_timer timestamps of the last connection attempt
+    volatile int64_t wifiStartUs_ = 0;
+    volatile int64_t wifiAssociatedUs_ = 0;
+    volatile int64_t wifiGotIpUs_ = 0;
+    DashboardConnection connection_;
+    FrameWriter frameWriter_;
+    FrameCache frameCache_;
+    PackBitsDecoder packBitsDecoder_;
+    MulticastReceiver multicast_;
+    // Values for rendering on the display, valid while dataEtag_ is set
+    DashboardData data_;
+    char dataEtag_[48] = "";
+    GlyphCache glyphs_;
+    DashboardRenderer renderer_;
+    // Decides when a full refresh removes the ghosting of the partial refreshes
+    GhostingBudget ghosting_;
+    RecoveryLadder recovery_;
     uint32_t currentDashboardHash_ = 0;
-    uint32_t identicalDraws_ = 0;
+    uint32_t downloadedHash_ = 0;
+    // ETag of the last completely downloaded dashboard, empty if unknown
+    char dashboardEtag_[48] = "";
+    // Remaining redraws of the unchanged dashboard
+    uint32_t contrastRedraws_ = 0;
+    // Strips changed by the last download
+    uint16_t changedStrips_ = 0;
+    // Learned durations of fetching the dashboard and the partial refresh per waveform
+    uint32_t fetchMs_ = 3000;
+    uint32_t refreshMs_[GxEPD2_426_GDEQ0426T82Mod::WAVEFORM_COUNT];
+    GxEPD2_426_GDEQ0426T82Mod::Waveform smallChangeWaveform_ = SMALL_CHANGE_WAVEFORM;
+    uint8_t waveformLut_[GxEPD2_426_GDEQ0426T82Mod::custom_lut_size];
+    // Start of the running refresh
+    int64_t refreshStart_ = 0;
+    bool refreshFull_ = false;
 
     // Static variables for QR code coordinates
     static int16_t qrCodeX_;
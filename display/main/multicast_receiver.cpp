@@ -0,0 +1,157 @@
+#include "multicast_receiver.h"
+#include <cerrno>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+
+namespace WeatherDisplay {
+
+static const char* TAG = "multicast";
+
+static inline uint32_t load32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (uint32_t(data[3]) << 24);
+}
+
+static inline uint16_t load16(const uint8_t* data) {
+    return data[0] | (data[1] << 8);
+}
+
+bool MulticastReceiver::begin(const char* group, uint16_t port) {
+    end();
+    socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socket_ < 0) {
+        ESP_LOGW(TAG, "Failed to create socket: %d", errno);
+        return false;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    struct ip_mreq membership = {};
+    membership.imr_multiaddr.s_addr = inet_addr(group);
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (bind(socket_, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        setsockopt(socket_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+        ESP_LOGW(TAG, "Failed to join %s:%u: %d", group, port, errno);
+        end();
+        return false;
+    }
+    ESP_LOGI(TAG, "Joined %s:%u", group, port);
+    return true;
+}
+
+void MulticastReceiver::end() {
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+    reset();
+}
+
+void MulticastReceiver::reset() {
+    hash_ = 0;
+    count_ = 0;
+    received_.reset();
+    changedStrips_ = 0;
+}
+
+bool MulticastReceiver::waitForFrame(uint32_t knownHash, uint32_t timeoutMs) {
+    int64_t deadline = esp_timer_get_time() / 1000 + timeoutMs;
+    int64_t now;
+    while (!pending() && (now = esp_timer_get_time() / 1000) < deadline) {
+        int len = receivePacket(deadline - now);
+        if (len < 0) {
+            break;
+        }
+        // Displays showing the frame ignore it, e.g. if it's sent again for others
+        if ((size_t)len >= HEADER_BYTES && load32(packet_ + 4) == knownHash) {
+            continue;
+        }
+        handlePacket(len);
+    }
+    return pending();
+}
+
+void MulticastReceiver::receive(uint32_t gapMs) {
+    while (pending() && !complete()) {
+        int len = receivePacket(gapMs);
+        if (len < 0) {
+            return;
+        }
+        handlePacket(len);
+    }
+}
+
+uint16_t MulticastReceiver::nextMissing(uint16_t from) const {
+    while (from < count_ && received_[from]) {
+        from++;
+    }
+    return from;
+}
+
+int MulticastReceiver::receivePacket(uint32_t timeoutMs) {
+    if (socket_ < 0) {
+        return -1;
+    }
+
+    // Sleep until a datagram arrives instead of polling
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socket_, &readSet);
+    struct timeval timeout = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+    if (select(socket_ + 1, &readSet, nullptr, nullptr, &timeout) <= 0) {
+        return -1;
+    }
+    // Longer datagrams are truncated and fail the checksum
+    int len = recv(socket_, packet_, sizeof(packet_), 0);
+    if (len < 0) {
+        return -1;
+    }
+    packets_++;
+    return len;
+}
+
+bool MulticastReceiver::handlePacket(size_t len) {
+    // The buffer beyond len still holds an earlier packet, thus check the length first
+    if (len != PACKET_BYTES) {
+        invalidPackets_++;
+        return false;
+    }
+    uint32_t hash = load32(packet_ + 4);
+    uint16_t index = load16(packet_ + 8);
+    uint16_t count = load16(packet_ + 10);
+    const uint8_t* rows = packet_ + HEADER_BYTES;
+    size_t rowsLen = len - HEADER_BYTES;
+    if (load32(packet_) != MAGIC || count != CHUNKS || index >= count ||
+        FrameWriter::hashWords(rows, rowsLen) != load32(packet_ + 12)) {
+        invalidPackets_++;
+        return false;
+    }
+
+    if (!pending() || hash != hash_) {
+        // A newer frame replaces an incomplete one
+        reset();
+        hash_ = hash;
+        count_ = count;
+        writer_.resetFlippedPixels();
+        frames_++;
+    }
+    if (received_[index]) {
+        return true;
+    }
+
+    writer_.begin(0, index * CHUNK_ROWS, FrameWriter::WIDTH, CHUNK_ROWS);
+    writer_.write(rows, rowsLen);
+    changedStrips_ += writer_.changedStrips();
+    received_[index] = true;
+    return true;
+}
+
+void MulticastReceiver::logStats() const {
+    ESP_LOGI(TAG, "%lu frames, %lu packets, %lu invalid", (unsigned long)frames_, (unsigned long)packets_,
+             (unsigned long)invalidPackets_);
+}
+
+} // namespace WeatherDisplay
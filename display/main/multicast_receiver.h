@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <bitset>
+#include "frame_writer.h"
+
+namespace WeatherDisplay {
+
+// Receives dashboards that the server sends once to a multicast group for all displays.
+//
+// Each frame is split into chunks of CHUNK_ROWS full-width PBM rows, and each chunk is
+// sent as one datagram. All numbers are little endian, see multicastFrame() in the server:
+//   u32 magic, u32 frame hash, u16 chunk index, u16 chunk count, u32 chunk checksum,
+//   followed by the pixel rows of the chunk
+// The checksum is FrameWriter::hashWords() over the pixel rows. Chunks are written into
+// the controller RAM as they arrive. Missing chunks are requested from the server in the
+// same format, see handlePacket().
+class MulticastReceiver {
+public:
+    static constexpr uint16_t CHUNK_ROWS = 2 * FrameWriter::STRIP_ROWS;
+    static constexpr uint16_t CHUNKS = FrameWriter::HEIGHT / CHUNK_ROWS;
+    static constexpr size_t HEADER_BYTES = 16;
+    static constexpr size_t PACKET_BYTES = HEADER_BYTES + CHUNK_ROWS * FrameWriter::ROW_BYTES;
+
+    explicit MulticastReceiver(FrameWriter& writer) : writer_(writer) {}
+
+    // Join the group, needed again after WiFi reconnected
+    bool begin(const char* group, uint16_t port);
+    void end();
+    bool active() const { return socket_ >= 0; }
+
+    // Wait up to timeoutMs for a chunk of a frame other than the one with the given hash.
+    // Returns true once such a frame is pending.
+    bool waitForFrame(uint32_t knownHash, uint32_t timeoutMs);
+    // Receive further chunks of the pending frame until it is complete or no datagram
+    // arrived for gapMs
+    void receive(uint32_t gapMs);
+
+    bool pending() const { return count_ > 0; }
+    bool complete() const { return pending() && received_.count() == count_; }
+    uint32_t hash() const { return hash_; }
+    uint16_t count() const { return count_; }
+    // First missing chunk at or after the given index, count() if there is none
+    uint16_t nextMissing(uint16_t from) const;
+    // Strips of the pending frame that differ from the previous controller RAM
+    uint16_t changedStrips() const { return changedStrips_; }
+    // Forget the pending frame
+    void reset();
+
+    // Buffer for a chunk packet received by other means, e.g. a unicast request
+    uint8_t* packet() { return packet_; }
+    // Validate the packet in the buffer and write its chunk. A packet of another frame
+    // replaces the pending one. Returns false for invalid packets.
+    bool handlePacket(size_t len);
+
+    void logStats() const;
+
+private:
+    static constexpr uint32_t MAGIC = 0x57444d43;
+
+    // Wait up to timeoutMs for a datagram and store it in the packet buffer. Returns its
+    // length, or -1 on timeout.
+    int receivePacket(uint32_t timeoutMs);
+
+    FrameWriter& writer_;
+    int socket_ = -1;
+
+    uint32_t hash_ = 0;
+    uint16_t count_ = 0;
+    std::bitset<CHUNKS> received_;
+    uint16_t changedStrips_ = 0;
+
+    uint32_t packets_ = 0;
+    uint32_t invalidPackets_ = 0;
+    uint32_t frames_ = 0;
+
+    alignas(uint32_t) uint8_t packet_[PACKET_BYTES];
+};
+
+} // namespace WeatherDisplay
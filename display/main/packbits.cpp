@@ -0,0 +1,50 @@
+#include "packbits.h"
+#include <cstring>
+
+namespace WeatherDisplay {
+
+void PackBitsDecoder::begin() {
+    state_ = State::HEADER;
+    count_ = 0;
+}
+
+void PackBitsDecoder::write(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        switch (state_) {
+        case State::HEADER: {
+            int8_t n = static_cast<int8_t>(*data);
+            if (n >= 0) {
+                count_ = n + 1;
+                state_ = State::LITERAL;
+            } else if (n != -128) {
+                count_ = 1 - n;
+                state_ = State::REPEAT;
+            }
+            data++;
+            len--;
+            break;
+        }
+        case State::LITERAL: {
+            // literal bytes are passed through without copying
+            size_t n = count_ < len ? count_ : len;
+            out_.write(data, n);
+            count_ -= n;
+            data += n;
+            len -= n;
+            if (count_ == 0) {
+                state_ = State::HEADER;
+            }
+            break;
+        }
+        case State::REPEAT:
+            memset(repeat_, *data, count_);
+            out_.write(repeat_, count_);
+            data++;
+            len--;
+            state_ = State::HEADER;
+            break;
+        }
+    }
+}
+
+} // namespace WeatherDisplay
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "frame_writer.h"
+
+namespace WeatherDisplay {
+
+// Incremental PackBits decoder that forwards the decoded pixel data to a FrameWriter.
+//
+// Each run starts with a header byte n. For 0 <= n <= 127, n + 1 literal bytes follow.
+// For -127 <= n <= -1, the next byte is repeated 1 - n times. n = -128 is ignored.
+// The decoder only keeps the state of the current run, thus the input can be split
+// into chunks at arbitrary positions.
+class PackBitsDecoder {
+public:
+    explicit PackBitsDecoder(FrameWriter& out) : out_(out) {}
+
+    void begin();
+    void write(const uint8_t* data, size_t len);
+
+private:
+    enum class State {
+        HEADER,
+        LITERAL,
+        REPEAT
+    };
+
+    static constexpr size_t MAX_RUN = 128;
+
+    FrameWriter& out_;
+    State state_ = State::HEADER;
+    // remaining bytes of the current run
+    size_t count_ = 0;
+    uint8_t repeat_[MAX_RUN];
+};
+
+} // namespace WeatherDisplay
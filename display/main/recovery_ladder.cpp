@@ -0,0 +1,112 @@
+#include "recovery_ladder.h"
+#include <algorithm>
+#include <esp_log.h>
+#include <iterator>
+
+namespace WeatherDisplay {
+
+static const char* TAG = "recovery";
+
+// Action taken on the n-th consecutive failure
+static constexpr RecoveryLadder::Action LADDER[] = {
+    RecoveryLadder::Action::RETRY,
+    RecoveryLadder::Action::RETRY,
+    RecoveryLadder::Action::RESET_CONNECTION,
+    RecoveryLadder::Action::RECONNECT_WIFI,
+    RecoveryLadder::Action::REINIT_DISPLAY,
+    RecoveryLadder::Action::RESTART,
+};
+
+void RecoveryLadder::begin(bool keepState) {
+    if (!keepState || state_.magic != MAGIC) {
+        state_ = {};
+        state_.magic = MAGIC;
+    }
+}
+
+RecoveryLadder::Action RecoveryLadder::onFailure(int64_t nowMs) {
+    if (state_.failures == 0) {
+        state_.faultStartMs = nowMs;
+    }
+    Action action = LADDER[std::min<size_t>(state_.failures, std::size(LADDER) - 1)];
+    state_.failures++;
+    state_.lastAction = action;
+    state_.restarted = false;
+    state_.stats[static_cast<size_t>(action)].attempts++;
+    if (action == Action::RESTART) {
+        // The state survives the restart, start over at the bottom of the ladder. Otherwise
+        // the new boot would keep the longest backoff and restart again on its next failure.
+        state_.failures = 0;
+        state_.faultStartMs = 0;
+        state_.restarted = true;
+    }
+    return action;
+}
+
+void RecoveryLadder::onActionDone(Action action, uint32_t durationMs) {
+    Stats& stats = state_.stats[static_cast<size_t>(action)];
+    stats.totalStepMs += durationMs;
+    stats.maxStepMs = std::max(stats.maxStepMs, durationMs);
+}
+
+bool RecoveryLadder::onSuccess(int64_t nowMs) {
+    if (state_.restarted) {
+        state_.restarted = false;
+        state_.stats[static_cast<size_t>(Action::RESTART)].fixes++;
+        ESP_LOGI(TAG, "Recovered by restart");
+        logStats();
+        return true;
+    }
+    if (state_.failures == 0) {
+        return false;
+    }
+
+    Stats& stats = state_.stats[static_cast<size_t>(state_.lastAction)];
+    uint32_t recoveryMs = std::max<int64_t>(nowMs - state_.faultStartMs, 0);
+    stats.fixes++;
+    stats.totalRecoveryMs += recoveryMs;
+    stats.maxRecoveryMs = std::max(stats.maxRecoveryMs, recoveryMs);
+    ESP_LOGI(TAG, "Recovered after %lu failures by %s in %lu ms", (unsigned long)state_.failures,
+             name(state_.lastAction), (unsigned long)recoveryMs);
+    state_.failures = 0;
+    logStats();
+    return true;
+}
+
+time_t RecoveryLadder::retryDelay() const {
+    uint32_t shift = std::min<uint32_t>(state_.failures > 0 ? state_.failures - 1 : 0, 8);
+    return std::min(MIN_RETRY_DELAY << shift, MAX_RETRY_DELAY);
+}
+
+void RecoveryLadder::logStats() const {
+    for (size_t i = 0; i < static_cast<size_t>(Action::COUNT); i++) {
+        const Stats& stats = state_.stats[i];
+        if (stats.attempts > 0) {
+            ESP_LOGI(TAG, "%-16s %lu attempts, step avg %lu ms, max %lu ms, %lu fixes, recovery avg %lu ms, max %lu ms",
+                     name(static_cast<Action>(i)), (unsigned long)stats.attempts,
+                     (unsigned long)(stats.totalStepMs / stats.attempts), (unsigned long)stats.maxStepMs,
+                     (unsigned long)stats.fixes,
+                     (unsigned long)(stats.fixes > 0 ? stats.totalRecoveryMs / stats.fixes : 0),
+                     (unsigned long)stats.maxRecoveryMs);
+        }
+    }
+}
+
+const char* RecoveryLadder::name(Action action) {
+    switch (action) {
+    case Action::RETRY:
+        return "retry";
+    case Action::RESET_CONNECTION:
+        return "reset connection";
+    case Action::RECONNECT_WIFI:
+        return "reconnect WiFi";
+    case Action::REINIT_DISPLAY:
+        return "reinit display";
+    case Action::RESTART:
+        return "restart";
+    default:
+        return "unknown";
+    }
+}
+
+} // namespace WeatherDisplay
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+namespace WeatherDisplay {
+
+// Escalating recovery from failed dashboard downloads.
+//
+// Each consecutive failure moves one rung up the ladder, from retrying with backoff over
+// resetting the connection, reconnecting WiFi and reinitializing the display up to
+// restarting the ESP. Once the restart is recorded, the ladder starts over, thus the new
+// boot retries quickly again. Per rung, the statistics count how often it was taken, how
+// long the action itself took, how often it ended a fault and how long recovery took.
+class RecoveryLadder {
+public:
+    enum class Action : uint8_t {
+        RETRY,
+        RESET_CONNECTION,
+        RECONNECT_WIFI,
+        REINIT_DISPLAY,
+        RESTART,
+        COUNT
+    };
+
+    struct Stats {
+        uint32_t attempts;
+        // duration of the action itself, e.g. reconnecting WiFi
+        uint32_t totalStepMs;
+        uint32_t maxStepMs;
+        // faults that ended after this was the last action taken
+        uint32_t fixes;
+        // time from the first failure until the next successful download, not tracked
+        // across restarts
+        uint32_t totalRecoveryMs;
+        uint32_t maxRecoveryMs;
+    };
+
+    // Plain data, kept in memory that survives restarts
+    struct State {
+        uint32_t magic;
+        uint32_t failures;
+        int64_t faultStartMs;
+        Action lastAction;
+        // The last action was a restart and no download has completed since
+        bool restarted;
+        Stats stats[static_cast<size_t>(Action::COUNT)];
+    };
+
+    explicit RecoveryLadder(State& state) : state_(state) {}
+
+    // Keep the state from before a restart if it is valid, otherwise start from scratch
+    void begin(bool keepState);
+
+    // Register a failed download at the given wall clock time, returns the action to take
+    Action onFailure(int64_t nowMs);
+    // Register how long taking the action returned by onFailure() took
+    void onActionDone(Action action, uint32_t durationMs);
+    // Register a successful download. Returns true if this ended a fault.
+    bool onSuccess(int64_t nowMs);
+    // Delay in seconds until the next attempt, doubles with each failure
+    time_t retryDelay() const;
+
+    uint32_t failures() const { return state_.failures; }
+    void logStats() const;
+    static const char* name(Action action);
+
+private:
+    static constexpr uint32_t MAGIC = 0x52434c32;
+    static constexpr time_t MIN_RETRY_DELAY = 60;
+    static constexpr time_t MAX_RETRY_DELAY = 15 * 60;
+
+    State& state_;
+};
+
+} // namespace WeatherDisplay
@@ -1,5 +1,6 @@
 import axios from 'axios';
 import escapeHtml from 'escape-html';
+import { readFile } from 'fs/promises';
 
 interface SensorData {
   entity_id: string;
@@ -7,7 +8,7 @@ interface SensorData {
   attributes?: Record<string, unknown>;
 }
 
-interface TemperatureSensor {
+export interface TemperatureSensor {
   title: string;
   temperature: number;
   humidity: number;
@@ -25,7 +26,7 @@ interface DisplayDeviceDescriptor {
 
 type TemperatureSensorsMap = { [location: string]: TemperatureSensor };
 
-interface DashboardData {
+export interface DashboardData {
   weatherState: string;
   sunriseTime?: string;
   sunsetTime?: string;
@@ -156,7 +157,7 @@ function calculateDewPoint(temperature: number, humidity: number): number {
   return (b * alpha) / (a - alpha);
 }
 
-function formatLocalTime(isoString: string, timezone: string = 'Europe/Berlin'): string {
+export function formatLocalTime(isoString: string, timezone: string = 'Europe/Berlin'): string {
   const date = new Date(isoString);
   return date.toLocaleTimeString('de-DE', {
     timeZone: timezone,
@@ -165,8 +166,7 @@ function formatLocalTime(isoString: string, timezone: string = 'Europe/Berlin'):
   });
 }
 
-function getGermanDate(): string {
-  const now = new Date();
+function getGermanDate(now: Date): string {
   const weekdays = ['Sonntag', 'Montag', 'Dienstag', 'Mittwoch', 'Donnerstag', 'Freitag', 'Samstag'];
   const months = ['Januar', 'Februar', 'März', 'April', 'Mai', 'Juni', 'Juli', 'August', 'September', 'Oktober', 'November', 'Dezember'];
   const weekday = weekdays[now.getDay()];
@@ -258,7 +258,7 @@ async function processSensorData(
 }
 
 // Rendering functions
-function getWeatherIcon(weatherState: string): string {
+export function getWeatherIcon(weatherState: string): string {
   const weatherIcons: { [key: string]: string } = {
     'clear-night': 'fa-moon',
     'cloudy': 'fa-cloud',
@@ -311,7 +311,7 @@ function renderRoomSection(sensors: TemperatureSensor): string {
   `;
 }
 
-function generateHtml(data: DashboardData): string {
+function generateHtml(data: DashboardData, now: Date): string {
   const weatherIcon = getWeatherIcon(data.weatherState);
   
   return `
@@ -420,7 +420,7 @@ function generateHtml(data: DashboardData): string {
         <div class="date">
           <i class="fas ${weatherIcon} weather-icon"></i>
           <div>
-          ${getGermanDate()}
+          ${getGermanDate(now)}
           ${data.sunriseTime && data.sunsetTime ? `
             <div class="sun-times">
               <div class="sun-info">
@@ -441,9 +441,57 @@ function generateHtml(data: DashboardData): string {
   `;
 }
 
-export async function renderDashboardHtml(): Promise<string> {
+// The sensor values change at any time, thus the dashboard is re-rendered in this interval
+const SENSOR_UPDATE_INTERVAL_MS = (Number(process.env.SENSOR_UPDATE_INTERVAL) || 300) * 1000;
+
+/**
+ * Returns the time at which the dashboard rendered for the given time should be updated next.
+ * Apart from the sensor values, only the date depends on the time, which changes at midnight.
+ */
+export function nextDashboardChange(now: Date): Date {
+  const midnight = new Date(now.getFullYear(), now.getMonth(), now.getDate() + 1);
+  return new Date(Math.min(midnight.getTime(), now.getTime() + SENSOR_UPDATE_INTERVAL_MS));
+}
+
+/** Fetches the values shown on the dashboard. */
+export async function fetchDashboardData(): Promise<DashboardData> {
+  // Fixed values instead of Home Assistant, e.g. for the fixtures of the firmware tests
+  if (process.env.DASHBOARD_DATA_FILE) {
+    return JSON.parse(await readFile(process.env.DASHBOARD_DATA_FILE, 'utf8'));
+  }
   const displayPlan = await fetchDisplayDeviceDescriptor();
   const sensorData = await fetchSensorData();
-  const data = await processSensorData(sensorData, displayPlan);
-  return generateHtml(data);
+  return processSensorData(sensorData, displayPlan);
+}
+
+/** Renders the dashboard as it should look at the given time. */
+export async function renderDashboardHtml(now: Date = new Date()): Promise<string> {
+  return generateHtml(await fetchDashboardData(), now);
+}
+
+/**
+ * Renders a single icon of the dashboard, for displays that render the dashboard themselves.
+ * The icon keeps the size it has in the dashboard, see DashboardRenderer in the firmware.
+ */
+export function generateGlyphHtml(icon: string, size: number): string {
+  return `
+    <html>
+      <head>
+        <link rel="stylesheet" href="/assets/fontawesome/css/all.min.css">
+        <style>
+          body {
+            margin: 0;
+            background-color: white;
+          }
+
+          i {
+            font-size: ${size}px;
+            line-height: 1;
+            vertical-align: top;
+          }
+        </style>
+      </head>
+      <body><i class="fas fa-${escapeHtml(icon)}"></i></body>
+    </html>
+  `;
 }
@@ -3,30 +3,45 @@ import axios from 'axios';
 import puppeteer, { Browser } from 'puppeteer';
 import dotenv from 'dotenv';
 import { Jimp } from 'jimp';
-import { renderDashboardHtml } from './dashboardTemplate';
+import { createHash } from 'crypto';
+import dgram from 'dgram';
+import {
+  DashboardData,
+  fetchDashboardData,
+  formatLocalTime,
+  generateGlyphHtml,
+  getWeatherIcon,
+  nextDashboardChange,
+  renderDashboardHtml
+} from './dashboardTemplate';
 
 dotenv.config();
 
-// Validate required environment variables
-if (!process.env.HA_URL) {
-  throw new Error('HA_URL environment variable is not set. Please set it in your .env file.');
-}
-if (!process.env.HA_TOKEN) {
-  throw new Error('HA_TOKEN environment variable is not set. Please set it in your .env file.');
-}
+// Validate required environment variables, Home Assistant is not queried with fixed values
+if (!process.env.DASHBOARD_DATA_FILE) {
+  if (!process.env.HA_URL) {
+    throw new Error('HA_URL environment variable is not set. Please set it in your .env file.');
+  }
+  if (!process.env.HA_TOKEN) {
+    throw new Error('HA_TOKEN environment variable is not set. Please set it in your .env file.');
+  }
 
-// Validate HA_URL format
-try {
-  new URL(process.env.HA_URL);
-} catch (e) {
-  throw new Error('HA_URL environment variable is not a valid URL. Please ensure it includes the protocol (http:// or https://).');
+  // Validate HA_URL format
+  try {
+    new URL(process.env.HA_URL);
+  } catch (e) {
+    throw new Error('HA_URL environment variable is not a valid URL. Please ensure it includes the protocol (http:// or https://).');
+  }
 }
 
 const app = express();
 const PORT = process.env.PORT || 3000;
 
-// Serve static files
-app.use('/assets', express.static('public/assets'));
+// Serve static files. The screenshots load the dashboard via setContent(), thus the page has
+// no origin and the web fonts are cross-origin requests.
+app.use('/assets', express.static('public/assets', {
+  setHeaders: (res) => res.set('Access-Control-Allow-Origin', '*'),
+}));
 
 // Store browser instance
 let browser: Browser | null = null;
@@ -39,21 +54,36 @@ async function initBrowser() {
   });
 }
 
+// Displays fetch the dashboard shortly before the minute in which it is shown.
+// Only accept render times close to the current time.
+const MAX_FRAME_TIME_OFFSET_MS = 5 * 60 * 1000;
+
+// Helper function to parse the time (in seconds since the epoch) to render the dashboard for
+function parseFrameTime(value: unknown): Date {
+  const now = Date.now();
+  const time = Number(value) * 1000;
+  if (!Number.isFinite(time) || Math.abs(time - now) > MAX_FRAME_TIME_OFFSET_MS) {
+    return new Date(now);
+  }
+  return new Date(time);
+}
+
 // Web page endpoint
 app.get('/', async (req, res) => {
-  const html = await renderDashboardHtml();
+  const html = await renderDashboardHtml(parseFrameTime(req.query.t));
   res.send(html);
 });
 
-// Helper function to get dashboard screenshot
-async function getDashboardScreenshot(): Promise<Buffer> {
+// Helper function to get a screenshot of the dashboard HTML. The page is loaded from the
+// string, thus Home Assistant isn't queried again. The base URL resolves the assets.
+async function getDashboardScreenshot(html: string): Promise<Buffer> {
   if (!browser) {
     throw new Error('Browser not initialized');
   }
 
   const page = await browser.newPage();
   await page.setViewport({ width: 480, height: 800 });
-  await page.goto(`http://localhost:${PORT}` , { waitUntil: 'networkidle0' });
+  await page.setContent(html.replace('<head>', `<head><base href="http://localhost:${PORT}/">`), { waitUntil: 'networkidle0' });
   const png = await page.screenshot({ type: 'png', optimizeForSpeed: true });
   await page.close();
 
@@ -109,19 +139,547 @@ function convertToPBM(image: any): Buffer {
   return buffer;
 }
 
+// Helper function to determine the length of the PBM header.
+// Header consists of the magic number and the dimensions, each terminated by a newline
+function pbmHeaderLength(pbm: Buffer): number {
+  return pbm.indexOf('\n', pbm.indexOf('\n') + 1) + 1;
+}
+
+// Helper function to compress the pixel data of a PBM image using PackBits.
+// The PBM header is kept as is, such that clients can parse it as usual.
+function compressPBM(pbm: Buffer): Buffer {
+  const headerLength = pbmHeaderLength(pbm);
+  const data = pbm.subarray(headerLength);
+  const out: number[] = [];
+
+  let i = 0;
+  while (i < data.length) {
+    // Length of the run of identical bytes starting at i
+    let run = 1;
+    while (run < 128 && i + run < data.length && data[i + run] === data[i]) {
+      run++;
+    }
+
+    if (run >= 2) {
+      out.push(1 - run, data[i]);
+      i += run;
+      continue;
+    }
+
+    // Collect literal bytes until the next run of at least three identical bytes
+    let literal = 1;
+    while (literal < 128 && i + literal < data.length) {
+      const j = i + literal;
+      if (j + 2 < data.length && data[j] === data[j + 1] && data[j] === data[j + 2]) {
+        break;
+      }
+      literal++;
+    }
+    out.push(literal - 1, ...data.subarray(i, i + literal));
+    i += literal;
+  }
+
+  return Buffer.concat([pbm.subarray(0, headerLength), Buffer.from(out.map(v => v & 0xFF))]);
+}
+
+// FNV-1a variant over 32 bit little endian words, see FrameWriter::hashWords()
+const HASH_OFFSET = 2166136261;
+const HASH_PRIME = 16777619;
+
+function hashWords(data: Buffer): number {
+  let hash = HASH_OFFSET;
+  for (let i = 0; i + 4 <= data.length; i += 4) {
+    hash = Math.imul(hash ^ data.readUInt32LE(i), HASH_PRIME);
+  }
+  return hash >>> 0;
+}
+
+// Hash of the PBM pixel data, must match the hash calculated by the display.
+// The display hashes each strip of eight rows and combines the strip hashes.
+function frameHash(pbm: Buffer): number {
+  const headerLength = pbmHeaderLength(pbm);
+  const [width] = pbm.toString('ascii', 3, headerLength).trim().split(' ').map(Number);
+  const stripBytes = 8 * Math.ceil(width / 8);
+  let hash = HASH_OFFSET;
+  for (let i = headerLength; i < pbm.length; i += stripBytes) {
+    hash = Math.imul(hash ^ hashWords(pbm.subarray(i, i + stripBytes)), HASH_PRIME);
+  }
+  return hash >>> 0;
+}
+
+// Recently served frames by their hash. These are the base for delta frames.
+const FRAME_CACHE_SIZE = 8;
+const frameCache = new Map<number, Buffer>();
+
+function cacheFrame(hash: number, pbm: Buffer) {
+  frameCache.delete(hash);
+  frameCache.set(hash, pbm);
+  if (frameCache.size > FRAME_CACHE_SIZE) {
+    // Maps iterate in insertion order, thus the first entry is the oldest one
+    frameCache.delete(frameCache.keys().next().value!);
+  }
+}
+
+// Helper function to compute the changes between two PBM images of the same size.
+// The changes are a list of patches covering all modified 8x8 pixel blocks:
+//   u16 patch count
+//   per patch: u16 x, y, width, height in pixels (multiples of 8), followed by the
+//   pixel rows of the patch in PBM format
+// All numbers are little endian. Returns null if the images are not comparable.
+function computeDelta(base: Buffer, pbm: Buffer): Buffer | null {
+  const headerLength = pbmHeaderLength(pbm);
+  if (base.length !== pbm.length || !base.subarray(0, headerLength).equals(pbm.subarray(0, headerLength))) {
+    return null;
+  }
+  const [width, height] = pbm.toString('ascii', 3, headerLength).trim().split(' ').map(Number);
+  const bytesPerRow = Math.ceil(width / 8);
+  const blockRows = Math.ceil(height / 8);
+
+  const blockChanged = (bx: number, by: number) => {
+    for (let y = by * 8; y < Math.min(by * 8 + 8, height); y++) {
+      const idx = headerLength + y * bytesPerRow + bx;
+      if (base[idx] !== pbm[idx]) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Merge changed blocks into horizontal spans and extend spans from the previous
+  // block row that have exactly the same horizontal extent
+  type Patch = { x: number; y: number; w: number; h: number };
+  const patches: Patch[] = [];
+  let previousRow: Patch[] = [];
+  for (let by = 0; by < blockRows; by++) {
+    const currentRow: Patch[] = [];
+    for (let bx = 0; bx < bytesPerRow; bx++) {
+      if (!blockChanged(bx, by)) {
+        continue;
+      }
+      let end = bx + 1;
+      while (end < bytesPerRow && blockChanged(end, by)) {
+        end++;
+      }
+      const rowHeight = Math.min(8, height - by * 8);
+      const above = previousRow.find(p => p.x === bx * 8 && p.w === (end - bx) * 8);
+      if (above) {
+        above.h += rowHeight;
+        currentRow.push(above);
+      } else {
+        const patch = { x: bx * 8, y: by * 8, w: (end - bx) * 8, h: rowHeight };
+        patches.push(patch);
+        currentRow.push(patch);
+      }
+      bx = end;
+    }
+    previousRow = currentRow;
+  }
+
+  const parts: Buffer[] = [];
+  const count = Buffer.alloc(2);
+  count.writeUInt16LE(patches.length);
+  parts.push(count);
+  for (const patch of patches) {
+    const header = Buffer.alloc(8);
+    header.writeUInt16LE(patch.x, 0);
+    header.writeUInt16LE(patch.y, 2);
+    header.writeUInt16LE(patch.w, 4);
+    header.writeUInt16LE(patch.h, 6);
+    parts.push(header);
+    for (let y = patch.y; y < patch.y + patch.h; y++) {
+      const start = headerLength + y * bytesPerRow + patch.x / 8;
+      parts.push(pbm.subarray(start, start + patch.w / 8));
+    }
+  }
+  return Buffer.concat(parts);
+}
+
+// Validator derived from the frame content. Displays send it back via If-None-Match to
+// skip downloading an unchanged frame. The same frame is sent as plain PBM, PackBits or
+// delta body, thus the validator is weak: it identifies the frame, not the bytes sent.
+function frameEtag(pbm: Buffer): string {
+  return `W/"${createHash('sha1').update(pbm).digest('hex')}"`;
+}
+
+// Tell clients when the dashboard rendered for the given time changes next, so they can skip
+// the fetches in between. X-Next-Update is the absolute time in seconds since the epoch.
+function setRefreshHint(res: Response, time: Date) {
+  const next = nextDashboardChange(time);
+  const maxAge = Math.max(0, Math.ceil((next.getTime() - Date.now()) / 1000));
+  res.set('Cache-Control', `max-age=${maxAge}`);
+  res.set('X-Next-Update', Math.floor(next.getTime() / 1000).toString());
+}
+
+// Helper function to send a frame in the encoding requested by the client
+function sendFrame(req: Request, res: Response, pbm: Buffer) {
+  res.set('Content-Type', 'application/octet-stream');
+  // Clients opt into compressed pixel data, plain PBM remains the default
+  if (req.get('X-Frame-Encoding') === 'packbits') {
+    res.set('X-Frame-Encoding', 'packbits');
+    res.send(compressPBM(pbm));
+    return;
+  }
+  res.send(pbm);
+}
+
+async function renderPBM(html: string): Promise<Buffer> {
+  const png = await getDashboardScreenshot(html);
+  const image = await convertToBlackWhite(png);
+  return convertToPBM(image);
+}
+
+interface RenderedFrame {
+  html: string;
+  pbm: Buffer;
+  hash: number;
+  etag: string;
+  time: Date;
+}
+
+// Last rendered frame. Rendering the HTML only queries Home Assistant, the screenshot is
+// only taken if the HTML differs. Thus, requests for an unchanged dashboard skip Puppeteer.
+let lastFrame: RenderedFrame | null = null;
+
+async function renderFrame(time: Date): Promise<RenderedFrame> {
+  const html = await renderDashboardHtml(time);
+  if (lastFrame && lastFrame.html === html) {
+    return lastFrame;
+  }
+  const pbm = await renderPBM(html);
+  const hash = frameHash(pbm);
+  cacheFrame(hash, pbm);
+  lastFrame = { html, pbm, hash, etag: frameEtag(pbm), time };
+  return lastFrame;
+}
+
+// Latest time requested via X-Frame-Time. Displays fetch the frame for the upcoming minute,
+// the watcher renders for the same time. Otherwise, it would push the previous date right
+// after a display fetched the dashboard for midnight.
+let latestFrameTime = 0;
+
+function currentFrameTime(): Date {
+  return new Date(Math.max(Date.now(), latestFrameTime));
+}
+
 // Binary endpoint
 app.get('/dashboard.pbm', async (req, res) => {
-  const png = await getDashboardScreenshot();
-  const image = await convertToBlackWhite(png);
-  const pbm = convertToPBM(image);
+  const time = new Date();
+  const { pbm, etag } = await renderFrame(time);
+
+  res.set('ETag', etag);
+  res.set('Vary', 'X-Frame-Encoding');
+  setRefreshHint(res, time);
+  if (req.fresh) {
+    res.status(304).end();
+    return;
+  }
+
+  sendFrame(req, res, pbm);
+});
+
+// Push updates: displays send X-Wait to hold the request until the dashboard changes.
+// A single watcher checks the dashboard for all displays and only renders it if its
+// content changed.
+const PUSH_CHECK_INTERVAL_MS = (Number(process.env.PUSH_CHECK_INTERVAL) || 10) * 1000;
+const MAX_WAIT_S = 30;
+// Stop watching once no display has waited for this long
+const WATCH_IDLE_MS = 2 * 60 * 1000;
+
+let watchedFrame: RenderedFrame | null = null;
+let watching = false;
+let lastWaitRequest = 0;
+const frameListeners = new Set<() => void>();
+
+async function watchDashboard() {
+  try {
+    const frame = await renderFrame(currentFrameTime());
+    const changed = frame.hash !== watchedFrame?.hash;
+    watchedFrame = frame;
+    if (changed) {
+      frameListeners.forEach(listener => listener());
+      multicastFrame(frame.pbm, frame.hash);
+    }
+  } catch (e) {
+    console.error('Failed to check the dashboard for changes:', e);
+  }
+
+  if (multicastSocket || Date.now() - lastWaitRequest < WATCH_IDLE_MS) {
+    setTimeout(watchDashboard, PUSH_CHECK_INTERVAL_MS);
+  } else {
+    watching = false;
+  }
+}
+
+function startWatching() {
+  lastWaitRequest = Date.now();
+  if (!watching) {
+    watching = true;
+    watchDashboard();
+  }
+}
+
+// Multicast: with MULTICAST_GROUP set, each new frame of the watcher is sent once to all
+// displays in the group. A frame is split into chunks of CHUNK_ROWS rows, one datagram each:
+//   u32 magic, u32 frame hash, u16 chunk index, u16 chunk count, u32 checksum (hashWords()
+//   of the rows), followed by the pixel rows of the chunk
+// All numbers are little endian. Displays request lost chunks via /dashboard.chunk.
+const MULTICAST_GROUP = process.env.MULTICAST_GROUP;
+const MULTICAST_PORT = Number(process.env.MULTICAST_PORT) || 3001;
+const MULTICAST_MAGIC = 0x57444d43;
+const CHUNK_ROWS = 16;
+// Pace the datagrams, displays only buffer a few of them
+const MULTICAST_PACKET_INTERVAL_MS = 5;
+
+let multicastSocket: dgram.Socket | null = null;
+
+function frameChunkCount(pbm: Buffer): number {
+  const headerLength = pbmHeaderLength(pbm);
+  const [, height] = pbm.toString('ascii', 3, headerLength).trim().split(' ').map(Number);
+  return Math.ceil(height / CHUNK_ROWS);
+}
+
+function frameChunk(pbm: Buffer, hash: number, index: number): Buffer {
+  const headerLength = pbmHeaderLength(pbm);
+  const [width] = pbm.toString('ascii', 3, headerLength).trim().split(' ').map(Number);
+  const chunkBytes = CHUNK_ROWS * Math.ceil(width / 8);
+  const rows = pbm.subarray(headerLength + index * chunkBytes, headerLength + (index + 1) * chunkBytes);
+  const header = Buffer.alloc(16);
+  header.writeUInt32LE(MULTICAST_MAGIC, 0);
+  header.writeUInt32LE(hash, 4);
+  header.writeUInt16LE(index, 8);
+  header.writeUInt16LE(frameChunkCount(pbm), 10);
+  header.writeUInt32LE(hashWords(rows), 12);
+  return Buffer.concat([header, rows]);
+}
+
+async function multicastFrame(pbm: Buffer, hash: number) {
+  if (!multicastSocket) {
+    return;
+  }
+  const count = frameChunkCount(pbm);
+  for (let i = 0; i < count; i++) {
+    multicastSocket.send(frameChunk(pbm, hash, i), MULTICAST_PORT, MULTICAST_GROUP);
+    await new Promise(resolve => setTimeout(resolve, MULTICAST_PACKET_INTERVAL_MS));
+  }
+}
+
+function initMulticast() {
+  if (!MULTICAST_GROUP) {
+    return;
+  }
+  multicastSocket = dgram.createSocket('udp4');
+  multicastSocket.on('error', e => console.error('Multicast failed:', e));
+  multicastSocket.bind(() => {
+    // Keep the datagrams within the local network
+    multicastSocket!.setMulticastTTL(1);
+    console.log(`Sending frames to ${MULTICAST_GROUP}:${MULTICAST_PORT}`);
+    startWatching();
+  });
+}
+
+// Resolves once the watched frame differs from the one with the given ETag, or after the timeout
+function waitForChange(etag: string | undefined, timeoutMs: number): Promise<void> {
+  const changed = () => watchedFrame !== null && watchedFrame.etag !== etag;
+  if (changed()) {
+    return Promise.resolve();
+  }
+  return new Promise(resolve => {
+    const done = () => {
+      clearTimeout(timer);
+      frameListeners.delete(listener);
+      resolve();
+    };
+    const listener = () => {
+      if (changed()) {
+        done();
+      }
+    };
+    const timer = setTimeout(done, timeoutMs);
+    frameListeners.add(listener);
+  });
+}
+
+// Send the frame, only the changes if the client still shows a known frame
+function sendDashboard(req: Request, res: Response, frame: RenderedFrame, time: Date) {
+  const { pbm, hash } = frame;
+  res.set('ETag', frame.etag);
+  res.set('Vary', 'X-Frame-Encoding, X-Frame-Base, X-Wait');
+  setRefreshHint(res, time);
+  if (req.fresh) {
+    res.status(304).end();
+    return;
+  }
+
+  const baseHash = parseInt(req.get('X-Frame-Base') ?? '', 16);
+  const base = frameCache.get(baseHash);
+  const delta = base ? computeDelta(base, pbm) : null;
+  if (delta && delta.length < pbm.length / 2) {
+    res.set('Content-Type', 'application/octet-stream');
+    res.set('X-Frame-Type', 'delta');
+    res.set('X-Frame-Hash', hash.toString(16).padStart(8, '0'));
+    res.send(delta);
+    return;
+  }
 
+  res.set('X-Frame-Type', 'full');
+  sendFrame(req, res, pbm);
+}
+
+// Delta endpoint. The client passes the hash of the frame it currently shows via
+// X-Frame-Base and receives only the changed parts if that frame is still known.
+// Otherwise, the response contains the full frame like /dashboard.pbm.
+app.get('/dashboard.delta', async (req, res) => {
+  const wait = Math.min(Number(req.get('X-Wait')) || 0, MAX_WAIT_S);
+  if (wait > 0) {
+    // Long-poll, answered with the watched frame once it differs from the client's
+    startWatching();
+    await waitForChange(req.get('If-None-Match'), wait * 1000);
+    if (watchedFrame) {
+      res.set('X-Long-Poll', wait.toString());
+      sendDashboard(req, res, watchedFrame, watchedFrame.time);
+      return;
+    }
+  }
+
+  // Clients may request the dashboard for the upcoming minute via X-Frame-Time
+  const time = parseFrameTime(req.get('X-Frame-Time'));
+  latestFrameTime = Math.max(latestFrameTime, time.getTime());
+  sendDashboard(req, res, await renderFrame(time), time);
+});
+
+// Single chunk of a recently sent frame in the multicast format, for displays that missed it
+app.get('/dashboard.chunk/:hash/:index', (req, res) => {
+  const hash = parseInt(req.params.hash, 16);
+  const index = Number(req.params.index);
+  const pbm = frameCache.get(hash);
+  if (!pbm || !Number.isInteger(index) || index < 0 || index >= frameChunkCount(pbm)) {
+    res.status(404).end();
+    return;
+  }
   res.set('Content-Type', 'application/octet-stream');
-  res.send(pbm);
+  res.send(frameChunk(pbm, hash, index));
+});
+
+// On-device rendering: displays fetch only the values shown on the dashboard and lay it out
+// themselves, see DashboardRenderer in the firmware. Icons are rendered here once per size.
+
+// Helper function to convert text to Latin-1, the character set of the display fonts
+function toLatin1(text: string): Buffer {
+  const converted = text.replace(/ß/g, 'ss').replace(/[^\x00-\xff]/g, '?');
+  return Buffer.from(converted.slice(0, 255), 'latin1');
+}
+
+// Measurements are sent in tenths, the minimum value marks unknown ones
+const NO_VALUE = -32768;
+
+function tenths(value: number): number {
+  if (!Number.isFinite(value)) {
+    return NO_VALUE;
+  }
+  return Math.max(NO_VALUE + 1, Math.min(32767, Math.round(value * 10)));
+}
+
+// Binary payload of the dashboard values, see DashboardData in the firmware:
+//   u8 version, string weather icon, string sunrise, string sunset, u8 room count
+//   per room: string title, i16 temperature, humidity, dew point, min, max, i8 battery
+// Strings consist of a u8 length followed by Latin-1 characters. All numbers are little endian.
+function encodeDashboardData(data: DashboardData): Buffer {
+  const parts: Buffer[] = [Buffer.from([1])];
+  const writeString = (text: string) => {
+    const encoded = toLatin1(text);
+    parts.push(Buffer.from([encoded.length]), encoded);
+  };
+
+  writeString(getWeatherIcon(data.weatherState).replace(/^fa-/, ''));
+  writeString(data.sunriseTime ? formatLocalTime(data.sunriseTime) : '');
+  writeString(data.sunsetTime ? formatLocalTime(data.sunsetTime) : '');
+
+  const rooms = Object.values(data.temperatureSensors).slice(0, 255);
+  parts.push(Buffer.from([rooms.length]));
+  for (const room of rooms) {
+    writeString(room.title);
+    const values = Buffer.alloc(11);
+    [room.temperature, room.humidity, room.dewPoint, room.min, room.max]
+      .forEach((value, i) => values.writeInt16LE(tenths(value), 2 * i));
+    values.writeInt8(room.battery !== undefined ? Math.max(0, Math.min(100, room.battery)) : -1, 10);
+    parts.push(values);
+  }
+  return Buffer.concat(parts);
+}
+
+// Values endpoint, the display renders the dashboard for the current date itself
+app.get('/dashboard.data', async (req, res) => {
+  const time = new Date();
+  const payload = encodeDashboardData(await fetchDashboardData());
+
+  res.set('ETag', frameEtag(payload));
+  setRefreshHint(res, time);
+  if (req.fresh) {
+    res.status(304).end();
+    return;
+  }
+
+  res.set('Content-Type', 'application/octet-stream');
+  res.send(payload);
+});
+
+// Page with a single icon, rendered by /dashboard.glyph
+app.get('/glyph', (req, res) => {
+  res.send(generateGlyphHtml(String(req.query.icon), Number(req.query.size)));
+});
+
+const MAX_GLYPH_SIZE = 200;
+
+interface Glyph {
+  pbm: Buffer;
+  // Width of the icon in the layout, the PBM image is padded to full bytes
+  advance: number;
+}
+
+// Icons only depend on their name and size, thus render each one once
+const glyphCache = new Map<string, Glyph>();
+
+async function renderGlyph(icon: string, size: number): Promise<Glyph> {
+  if (!browser) {
+    throw new Error('Browser not initialized');
+  }
+
+  const page = await browser.newPage();
+  await page.setViewport({ width: 2 * size, height: size });
+  await page.goto(`http://localhost:${PORT}/glyph?icon=${icon}&size=${size}`, { waitUntil: 'networkidle0' });
+  const advance = Math.ceil(await page.$eval('i', el => el.getBoundingClientRect().width));
+  const width = Math.max(8, Math.ceil(advance / 8) * 8);
+  const png = await page.screenshot({ type: 'png', clip: { x: 0, y: 0, width, height: size } });
+  await page.close();
+
+  const image = await convertToBlackWhite(Buffer.from(png));
+  return { pbm: convertToPBM(image), advance };
+}
+
+// Icon endpoint, returns the icon as PBM with its layout width in X-Glyph-Advance
+app.get('/dashboard.glyph/:icon/:size', async (req, res) => {
+  const icon = req.params.icon;
+  const size = Number(req.params.size);
+  if (!/^[a-z0-9-]+$/.test(icon) || !Number.isInteger(size) || size < 8 || size > MAX_GLYPH_SIZE) {
+    res.status(404).end();
+    return;
+  }
+
+  const key = `${icon}/${size}`;
+  let glyph = glyphCache.get(key);
+  if (!glyph) {
+    glyph = await renderGlyph(icon, size);
+    glyphCache.set(key, glyph);
+  }
+
+  res.set('Content-Type', 'image/x-portable-bitmap');
+  res.set('X-Glyph-Advance', glyph.advance.toString());
+  res.send(glyph.pbm);
 });
 
 // Black and white PNG endpoint
 app.get('/dashboard.png', async (req, res) => {
-  const png = await getDashboardScreenshot();
+  const png = await getDashboardScreenshot(await renderDashboardHtml());
   const image = await convertToBlackWhite(png);
   const buffer = await image.getBuffer('image/png');
 
@@ -131,15 +689,22 @@ app.get('/dashboard.png', async (req, res) => {
 
 const server = app.listen(PORT, async () => {
   await initBrowser();
+  initMulticast();
   console.log(`Server running on port ${PORT}`);
 });
 
+// Displays keep their connection open between the refreshes once per minute.
+// The default keep-alive timeout of 5 seconds would close it after each request.
+server.keepAliveTimeout = 5 * 60 * 1000;
+server.headersTimeout = server.keepAliveTimeout + 1000;
+
 // Handle graceful shutdown
 process.on('SIGINT', async () => {
   console.log('Shutting down server...');
   if (browser) {
     await browser.close();
   }
+  multicastSocket?.close();
   server.close(() => {
     console.log('Server closed');
     process.exit(0);